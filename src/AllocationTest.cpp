@@ -0,0 +1,136 @@
+#ifdef _WIN32
+// Socket.h has to come first, see the note there.
+#include "Socket.h"
+
+#include "DeviceEventHandler.h"
+#endif
+
+#include "FlightRecorder.h"
+#include "FunctionRef.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <string_view>
+
+// Checks that the code that runs on every device event doesn't allocate, by counting calls to the global operator new.
+
+namespace {
+
+	// Only allocations made by the thread under test are counted, so that background threads (e.g. TVController's) can't
+	// make the tests flaky.
+	thread_local size_t allocationCount = 0;
+
+}
+
+#ifdef _MSC_VER
+// Inconsistent annotation for 'new'.
+#pragma warning(disable: 28251)
+#endif
+
+void* operator new(std::size_t size) {
+	++allocationCount;
+	if (const auto pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		constexpr std::wstring_view DEVICE_NAME = L"\\\\?\\USB#VID_046D&PID_C52B&MI_00#7&2a8b3c4d&0&0000#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+
+		// Runs `function` once to let buffers grow and caches fill up, then returns the number of allocations made by a
+		// second run.
+		size_t CountSteadyStateAllocations(FunctionRef<void()> function) {
+			function();
+			const auto allocationCountBefore = allocationCount;
+			function();
+			return allocationCount - allocationCountBefore;
+		}
+
+		TEST(AllocationTest, CountsAllocations) {
+			EXPECT_EQ(CountSteadyStateAllocations([] {
+				// Volatile, so that the compiler can't elide the allocation.
+				int* volatile pointer = new int;
+				delete pointer;
+			}), 1);
+		}
+
+		TEST(AllocationTest, Log) {
+			EXPECT_EQ(CountSteadyStateAllocations([] {
+				Log(Log::Level::INFO) << L"Device added: " << DEVICE_NAME;
+				Log(Log::Level::INFO) << L"Device added; switching LGTV to input: " << Log::UTF8("HDMI_1");
+			}), 0);
+		}
+
+		TEST(AllocationTest, FlightRecorder) {
+			EXPECT_EQ(CountSteadyStateAllocations([] {
+				FlightRecorder::Write(FlightRecorder::RecordType::DEVICE_ADDED, DEVICE_NAME);
+				FlightRecorder::Write(FlightRecorder::RecordType::RULE_MATCH, std::string_view("HDMI_1"));
+			}), 0);
+		}
+
+		TEST(AllocationTest, Trace) {
+			EXPECT_EQ(CountSteadyStateAllocations([] {
+				const Trace::Event traceEvent;
+				const Trace::Span traceSpan("Rule matching");
+			}), 0);
+		}
+
+#ifdef _WIN32
+		constexpr std::wstring_view OTHER_DEVICE_NAME = L"\\\\?\\USB#VID_046D&PID_C52B&MI_01#7&2a8b3c4d&0&0001#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+
+		// Exercises the same path as LGTVDeviceListener, including forwarding and TV commands. The TV is unreachable, so
+		// commands keep failing in the background, which doesn't matter here.
+		TEST(AllocationTest, DeviceEventHandler) {
+			const WinsockInitializer winsockInitializer;
+			// Forwarded events are sent to a socket that never reads them.
+			const Socket forwardingDestination(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			::sockaddr_in address = { .sin_family = AF_INET };
+			address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+			int addressSize = sizeof(address);
+			ASSERT_EQ(::bind(forwardingDestination.Get(), reinterpret_cast<const ::sockaddr*>(&address), addressSize), 0);
+			ASSERT_EQ(::getsockname(forwardingDestination.Get(), reinterpret_cast<::sockaddr*>(&address), &addressSize), 0);
+			EventForwarder eventForwarder({ .destination = "127.0.0.1:" + std::to_string(::ntohs(address.sin_port)), .key = "key" });
+
+			TVController tvController({ .url = "ws://127.0.0.1:9" });
+			const std::atomic<std::shared_ptr<const Rules>> rules = std::make_shared<const Rules>(Rules{
+				.deviceName = std::wstring(DEVICE_NAME),
+				.addInput = "HDMI_1",
+				.removeInput = "HDMI_2",
+			});
+			DeviceEventHandler deviceEventHandler(rules, &tvController, &eventForwarder);
+
+			EXPECT_EQ(CountSteadyStateAllocations([&] {
+				for (const auto deviceName : { OTHER_DEVICE_NAME, DEVICE_NAME })
+					for (const auto deviceEventType : { DeviceEventType::ADDED, DeviceEventType::REMOVED }) {
+						const Trace::Event traceEvent;
+						deviceEventHandler.OnLocalEvent(deviceEventType, deviceName);
+					}
+				const Trace::Event traceEvent;
+				deviceEventHandler.OnForwardedEvent(DeviceEventType::ADDED, DEVICE_NAME);
+			}), 0);
+		}
+#endif
+
+	}
+}
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	const auto directory = std::filesystem::temp_directory_path();
+	::LGTVDeviceListener::Log::Initialize({ .verbose = true, .channel = ::LGTVDeviceListener::Log::Channel::STDERR });
+	::LGTVDeviceListener::Trace::Initialize(directory / "LGTVDeviceListener-allocation-test.trace.json");
+	::LGTVDeviceListener::FlightRecorder::Initialize(directory / "LGTVDeviceListener-allocation-test.flight-recorder", 64);
+
+	return RUN_ALL_TESTS();
+}
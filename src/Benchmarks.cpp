@@ -0,0 +1,207 @@
+#include "DeviceEventType.h"
+#include "FlightRecorder.h"
+#include "FunctionRef.h"
+#include "LGTVProtocol.h"
+#include "StringUtil.h"
+#include "Log.h"
+#ifdef _WIN32
+#include "Rules.h"
+#endif
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Micro-benchmarks for the code that runs on every device event. Run with `--benchmark_format=json` (or
+// `--benchmark_out=<file> --benchmark_out_format=json`) to get machine-readable results.
+//
+// Benchmarks of code that relies on Windows APIs (string conversions, rule matching) are only built on Windows; the rest
+// also builds and runs on other platforms.
+
+#ifdef _MSC_VER
+#define LGTVDEVICELISTENER_NOINLINE __declspec(noinline)
+#else
+#define LGTVDEVICELISTENER_NOINLINE __attribute__((noinline))
+#endif
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		// A typical device name for a USB receiver, and a sibling interface of the same device that differs only near the
+		// end, which is the worst case for matching.
+		constexpr std::wstring_view DEVICE_NAME = L"\\\\?\\USB#VID_046D&PID_C52B&MI_00#7&2a8b3c4d&0&0000#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+		constexpr std::wstring_view OTHER_DEVICE_NAME = L"\\\\?\\USB#VID_046D&PID_C52B&MI_01#7&2a8b3c4d&0&0001#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+
+		// Real SSAP messages, as sent and received by LGTVClient.
+		constexpr std::string_view REGISTERED_RESPONSE = R"({"type":"registered","id":1,"payload":{"client-key":"0123456789abcdef0123456789abcdef"}})";
+		constexpr std::string_view SWITCH_INPUT_RESPONSE = R"({"type":"response","id":2,"payload":{"returnValue":true}})";
+		constexpr std::string_view EXTERNAL_INPUT_LIST_RESPONSE = R"({"type":"response","id":3,"payload":{"devices":[)"
+			R"({"id":"HDMI_1","label":"HDMI 1","port":1,"connected":true,"appId":"com.webos.app.hdmi1","icon":"http://192.168.1.42:3000/resources/c2a3f4e5/hdmi.png","modified":false,"lastUniqueId":0,"subList":[],"subCount":0,"favorite":false},)"
+			R"({"id":"HDMI_2","label":"PC","port":2,"connected":true,"appId":"com.webos.app.hdmi2","icon":"http://192.168.1.42:3000/resources/d3b4a5f6/pc.png","modified":true,"lastUniqueId":0,"subList":[],"subCount":0,"favorite":false},)"
+			R"({"id":"HDMI_3","label":"HDMI 3","port":3,"connected":false,"appId":"com.webos.app.hdmi3","icon":"http://192.168.1.42:3000/resources/e4c5b6a7/hdmi.png","modified":false,"lastUniqueId":0,"subList":[],"subCount":0,"favorite":false},)"
+			R"({"id":"HDMI_4","label":"HDMI 4","port":4,"connected":false,"appId":"com.webos.app.hdmi4","icon":"http://192.168.1.42:3000/resources/f5d6c7b8/hdmi.png","modified":false,"lastUniqueId":0,"subList":[],"subCount":0,"favorite":false})"
+			R"(],"returnValue":true}})";
+
+		void BM_Log(benchmark::State& state) {
+			const auto level = static_cast<Log::Level>(state.range(0));
+			state.SetLabel(Log::IsEnabled(level) ? "enabled" : "disabled");
+			for (auto _ : state)
+				Log(level) << L"Device added: " << DEVICE_NAME;
+		}
+		BENCHMARK(BM_Log)->DenseRange(int(Log::Level::VERBOSE), int(Log::Level::ERR));
+
+		constexpr std::string_view ASCII_TEXT = "\\\\?\\USB#VID_046D&PID_C52B&MI_00#7&2a8b3c4d&0&0000#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+		constexpr std::string_view NON_ASCII_TEXT = "LG Remote App 리모컨 앱 ЛГ Rэмotэ AПП";
+
+		void BM_DecodeUTF8(benchmark::State& state, std::string_view input) {
+			std::u16string output(input.size(), 0);
+			for (auto _ : state)
+				benchmark::DoNotOptimize(DecodeUTF8(input, std::span(output)));
+			state.SetBytesProcessed(state.iterations() * int64_t(input.size()));
+		}
+		BENCHMARK_CAPTURE(BM_DecodeUTF8, ASCII, ASCII_TEXT);
+		BENCHMARK_CAPTURE(BM_DecodeUTF8, NonASCII, NON_ASCII_TEXT);
+
+#ifdef _WIN32
+		// The conversion DecodeUTF8() replaced: MultiByteToWideChar() into the same preallocated buffer, for comparison
+		// with BM_DecodeUTF8.
+		void BM_MultiByteToWideChar(benchmark::State& state, std::string_view input) {
+			std::wstring output(input.size(), 0);
+			for (auto _ : state)
+				benchmark::DoNotOptimize(::MultiByteToWideChar(CP_UTF8, 0, input.data(), int(input.size()), output.data(), int(output.size())));
+			state.SetBytesProcessed(state.iterations() * int64_t(input.size()));
+		}
+		BENCHMARK_CAPTURE(BM_MultiByteToWideChar, ASCII, ASCII_TEXT);
+		BENCHMARK_CAPTURE(BM_MultiByteToWideChar, NonASCII, NON_ASCII_TEXT);
+
+		void BM_ToWideString_ASCII(benchmark::State& state) {
+			const std::string input = "\\\\?\\USB#VID_046D&PID_C52B&MI_00#7&2a8b3c4d&0&0000#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+			for (auto _ : state)
+				benchmark::DoNotOptimize(ToWideString(input, CP_UTF8));
+			state.SetBytesProcessed(state.iterations() * int64_t(input.size()));
+		}
+		BENCHMARK(BM_ToWideString_ASCII);
+
+		void BM_ToWideString_NonASCII(benchmark::State& state) {
+			const std::string input = "LG Remote App 리모컨 앱 ЛГ Rэмotэ AПП";
+			for (auto _ : state)
+				benchmark::DoNotOptimize(ToWideString(input, CP_UTF8));
+			state.SetBytesProcessed(state.iterations() * int64_t(input.size()));
+		}
+		BENCHMARK(BM_ToWideString_NonASCII);
+
+		void BM_ToWideString_ACP(benchmark::State& state) {
+			const std::string input = "Unable to reach WebSocket server at wss://192.168.1.42:3001";
+			for (auto _ : state)
+				benchmark::DoNotOptimize(ToWideString(input, CP_ACP));
+			state.SetBytesProcessed(state.iterations() * int64_t(input.size()));
+		}
+		BENCHMARK(BM_ToWideString_ACP);
+#endif
+
+		// Builds and serializes a request, as LGTVClient does. Each request is then completed by delivering its response, so
+		// that the in-flight request map doesn't grow over the run; that part is left out of the measured time.
+		void BM_SerializeRequest(benchmark::State& state, nlohmann::json (*makeRequest)()) {
+			LGTVProtocol protocol;
+			uint32_t requestId = 0;
+			for (auto _ : state) {
+				const auto start = std::chrono::steady_clock::now();
+				benchmark::DoNotOptimize(protocol.IssueRequest(makeRequest(), [](std::string_view, const nlohmann::json&) { return true; }));
+				state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+				protocol.OnMessage(R"({"type":"response","id":)" + std::to_string(++requestId) + R"(,"payload":{"returnValue":true}})");
+			}
+		}
+		BENCHMARK_CAPTURE(BM_SerializeRequest, Register, [] {
+			return GetRegisterRequest("0123456789abcdef0123456789abcdef");
+		})->UseManualTime();
+		BENCHMARK_CAPTURE(BM_SerializeRequest, SwitchInput, [] {
+			return GetSwitchInputRequest("HDMI_1");
+		})->UseManualTime();
+
+		void BM_ParseMessage(benchmark::State& state, std::string_view message) {
+			for (auto _ : state)
+				benchmark::DoNotOptimize(nlohmann::json::parse(message));
+			state.SetBytesProcessed(state.iterations() * int64_t(message.size()));
+		}
+		BENCHMARK_CAPTURE(BM_ParseMessage, Registered, REGISTERED_RESPONSE);
+		BENCHMARK_CAPTURE(BM_ParseMessage, SwitchInput, SWITCH_INPUT_RESPONSE);
+		BENCHMARK_CAPTURE(BM_ParseMessage, ExternalInputList, EXTERNAL_INPUT_LIST_RESPONSE);
+
+		// Parses a response, looks up its in-flight request, and calls its handler, as LGTVClient does for every message it
+		// receives. The handler reports that more responses are expected, so that the same request can keep being answered
+		// without issuing new ones; the only difference with a real client is that the request is never erased.
+		void BM_DispatchMessage(benchmark::State& state) {
+			LGTVProtocol protocol;
+			protocol.IssueRequest(GetRegisterRequest("0123456789abcdef0123456789abcdef"), [](std::string_view, const nlohmann::json&) { return true; });
+			protocol.IssueRequest(GetSwitchInputRequest("HDMI_1"), [](std::string_view type, const nlohmann::json& payload) {
+				CheckResponse(type, payload, "switchInput");
+				return false;
+			});
+			for (auto _ : state)
+				protocol.OnMessage(SWITCH_INPUT_RESPONSE);
+			state.SetBytesProcessed(state.iterations() * int64_t(SWITCH_INPUT_RESPONSE.size()));
+		}
+		BENCHMARK(BM_DispatchMessage);
+
+#ifdef _WIN32
+		void BM_RulesMatches(benchmark::State& state, std::wstring_view deviceName) {
+			const Rules rules = { .deviceName = std::wstring(DEVICE_NAME), .addInput = "HDMI_1", .removeInput = "HDMI_2" };
+			for (auto _ : state)
+				benchmark::DoNotOptimize(rules.Matches(deviceName));
+		}
+		BENCHMARK_CAPTURE(BM_RulesMatches, Match, DEVICE_NAME);
+		BENCHMARK_CAPTURE(BM_RulesMatches, Mismatch, OTHER_DEVICE_NAME);
+#endif
+
+		using OnEvent = void(DeviceEventType, std::wstring_view deviceName);
+
+		// Kept out of line so that the compiler can't see through the callback type.
+		LGTVDEVICELISTENER_NOINLINE void DispatchThroughStdFunction(const std::function<OnEvent>& onEvent) {
+			onEvent(DeviceEventType::ADDED, DEVICE_NAME);
+		}
+		LGTVDEVICELISTENER_NOINLINE void DispatchThroughFunctionRef(FunctionRef<OnEvent> onEvent) {
+			onEvent(DeviceEventType::ADDED, DEVICE_NAME);
+		}
+
+		void BM_DispatchEvent_StdFunction(benchmark::State& state) {
+			size_t count = 0;
+			for (auto _ : state)
+				DispatchThroughStdFunction([&](DeviceEventType, std::wstring_view deviceName) { count += deviceName.size(); });
+			benchmark::DoNotOptimize(count);
+		}
+		BENCHMARK(BM_DispatchEvent_StdFunction);
+
+		void BM_DispatchEvent_FunctionRef(benchmark::State& state) {
+			size_t count = 0;
+			for (auto _ : state)
+				DispatchThroughFunctionRef([&](DeviceEventType, std::wstring_view deviceName) { count += deviceName.size(); });
+			benchmark::DoNotOptimize(count);
+		}
+		BENCHMARK(BM_DispatchEvent_FunctionRef);
+
+		void BM_FlightRecorderWrite(benchmark::State& state) {
+			for (auto _ : state)
+				FlightRecorder::Write(FlightRecorder::RecordType::DEVICE_ADDED, DEVICE_NAME);
+		}
+		BENCHMARK(BM_FlightRecorderWrite);
+
+	}
+}
+
+int main(int argc, char** argv) {
+	::LGTVDeviceListener::Log::Initialize({ .verbose = false, .channel = ::LGTVDeviceListener::Log::Channel::NONE });
+	::LGTVDeviceListener::FlightRecorder::Initialize(std::filesystem::temp_directory_path() / L"LGTVDeviceListener-benchmark.flight-recorder", 4096);
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return EXIT_FAILURE;
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+	return EXIT_SUCCESS;
+}
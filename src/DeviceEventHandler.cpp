@@ -0,0 +1,95 @@
+#include "DeviceEventHandler.h"
+
+#include "FlightRecorder.h"
+#include "StringUtil.h"
+#include "Log.h"
+#include "Trace.h"
+
+namespace LGTVDeviceListener {
+
+	DeviceEventHandler::DeviceEventHandler(const std::atomic<std::shared_ptr<const Rules>>& rules, TVController* tvController, EventForwarder* eventForwarder) :
+		rules(rules), tvController(tvController), eventForwarder(eventForwarder) {}
+
+	void DeviceEventHandler::ApplyOnStart(bool receivingForwardedEvents) {
+		const auto currentRules = rules.load();
+		if (!currentRules->deviceName.has_value()) {
+			Log(Log::Level::WARNING) << L"Ignoring --apply-on-start because no device name was specified";
+			return;
+		}
+
+		// Not being able to apply the rules on startup shouldn't prevent us from processing device events.
+		try {
+			const auto present = devicePresence.IsPresent(*currentRules->deviceName);
+			if (!present && receivingForwardedEvents) {
+				Log(Log::Level::INFO) << L"Device absent on startup, but it might be plugged into a host forwarding its events; not switching LGTV input until the next device event";
+				return;
+			}
+			ApplyRules(*currentRules, present ? DeviceEventType::ADDED : DeviceEventType::REMOVED, present ? L"present on startup" : L"absent on startup");
+		}
+		catch (const std::exception& exception) {
+			Log(Log::Level::WARNING) << L"Unable to apply rules on startup: " << ToWideString(exception.what(), CP_ACP);
+		}
+	}
+
+	void DeviceEventHandler::OnLocalEvent(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+		devicePresence.Update(deviceEventType, deviceName);
+		// Forward first, so that the remote host doesn't have to wait for the local rules to be applied.
+		if (eventForwarder != nullptr) {
+			try {
+				eventForwarder->Forward(deviceEventType, deviceName);
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::WARNING) << L"Unable to forward device event: " << ToWideString(exception.what(), CP_ACP);
+			}
+		}
+		HandleEvent(deviceEventType, deviceName, /*forwarded=*/false);
+	}
+
+	void DeviceEventHandler::OnForwardedEvent(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+		HandleEvent(deviceEventType, deviceName, /*forwarded=*/true);
+	}
+
+	void DeviceEventHandler::HandleEvent(DeviceEventType deviceEventType, std::wstring_view deviceName, bool forwarded) {
+		const auto deviceEventTypeString = [&] {
+			switch (deviceEventType) {
+			case DeviceEventType::ADDED: return forwarded ? L"added on remote host" : L"added";
+			case DeviceEventType::REMOVED: return forwarded ? L"removed on remote host" : L"removed";
+			}
+			::abort();
+		}();
+
+		FlightRecorder::Write(deviceEventType == DeviceEventType::ADDED ? FlightRecorder::RecordType::DEVICE_ADDED : FlightRecorder::RecordType::DEVICE_REMOVED, deviceName);
+
+		const auto currentRules = rules.load();
+		Log(!currentRules->deviceName.has_value() ? Log::Level::INFO : Log::Level::VERBOSE) << L"Device " << deviceEventTypeString << L": " << deviceName;
+
+		{
+			const Trace::Span traceSpan("Rule matching");
+			if (!currentRules->Matches(deviceName)) {
+				// A device typically shows up as a burst of events, one per interface. Start connecting to the TV as soon
+				// as the first one comes in, so that the connection is ready by the time the matching event does.
+				if (tvController != nullptr && currentRules->GetInput(deviceEventType).has_value() && currentRules->MightMatch(deviceName))
+					tvController->WarmUp();
+				return;
+			}
+		}
+
+		ApplyRules(*currentRules, deviceEventType, deviceEventTypeString);
+	}
+
+	void DeviceEventHandler::ApplyRules(const Rules& currentRules, DeviceEventType deviceEventType, const wchar_t* deviceState) {
+		const auto& input = currentRules.GetInput(deviceEventType);
+		if (!input.has_value()) {
+			Log(Log::Level::INFO) << L"Device " << deviceState << L"; ignoring since no TV input to switch to was specified for this event";
+			return;
+		}
+
+		FlightRecorder::Write(FlightRecorder::RecordType::RULE_MATCH, *input);
+		const auto loggingOnly = tvController == nullptr;
+		Log(Log::Level::INFO) << L"Device " << deviceState << L"; " << (loggingOnly ? L"would have switched" : L"switching") << L" LGTV to input: " << Log::UTF8(*input);
+		if (loggingOnly) return;
+
+		tvController->SetInput(*input);
+	}
+
+}
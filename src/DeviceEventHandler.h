@@ -0,0 +1,53 @@
+#pragma once
+
+#include "DeviceListener.h"
+#include "DevicePresence.h"
+#include "EventForwarding.h"
+#include "Rules.h"
+#include "TVController.h"
+
+#include <atomic>
+#include <memory>
+#include <string_view>
+
+namespace LGTVDeviceListener {
+
+	// Applies the rules to device events: logs them, records them, forwards them to another host, and tells the TV which
+	// input to switch to.
+	//
+	// This runs on every device event, so it is expected not to allocate once warmed up (see AllocationTest.cpp).
+	class DeviceEventHandler final {
+	public:
+		// `rules` is loaded on every event, so that it can be replaced at any time without blocking event processing.
+		// If `tvController` is null, TV commands are only logged. If `eventForwarder` is not null, local events are
+		// forwarded through it. All three must outlive the handler.
+		DeviceEventHandler(const std::atomic<std::shared_ptr<const Rules>>& rules, TVController* tvController, EventForwarder* eventForwarder);
+
+		DeviceEventHandler(const DeviceEventHandler&) = delete;
+		DeviceEventHandler& operator=(const DeviceEventHandler&) = delete;
+
+		// Applies the rules to the current state of the device named in the rules, as if it had just been added or
+		// removed. Should be called after local device events start being delivered, so that no change can be missed.
+		// Only local devices can be enumerated: if `receivingForwardedEvents`, a device that is absent locally might be
+		// plugged into the remote host, so nothing is done until its next event.
+		void ApplyOnStart(bool receivingForwardedEvents);
+
+		// Must be called from a single thread.
+		void OnLocalEvent(DeviceEventType, std::wstring_view deviceName);
+
+		// For events received from another host. Can be called concurrently with OnLocalEvent().
+		// These don't update device presence, which only tracks local devices.
+		void OnForwardedEvent(DeviceEventType, std::wstring_view deviceName);
+
+	private:
+		void HandleEvent(DeviceEventType, std::wstring_view deviceName, bool forwarded);
+		// `deviceState` describes the device event or state being acted upon, e.g. "added".
+		void ApplyRules(const Rules&, DeviceEventType, const wchar_t* deviceState);
+
+		const std::atomic<std::shared_ptr<const Rules>>& rules;
+		TVController* const tvController;
+		EventForwarder* const eventForwarder;
+		DevicePresence devicePresence;
+	};
+
+}
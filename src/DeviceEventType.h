@@ -0,0 +1,7 @@
+#pragma once
+
+namespace LGTVDeviceListener {
+
+	enum class DeviceEventType { REMOVED, ADDED };
+
+}
@@ -2,9 +2,12 @@
 
 #include "StringUtil.h"
 #include "Log.h"
+#include "Trace.h"
 
 #include <Windows.h>
 #include <Dbt.h>
+#include <cfgmgr32.h>
+#include <objbase.h>
 
 #include <system_error>
 #include <iostream>
@@ -17,7 +20,7 @@ namespace LGTVDeviceListener {
 		public:
 			using OnMessage = void(HWND window, UINT messageIdentifier, WPARAM wParam, LPARAM lParam);
 
-			Window(std::function<OnMessage> onMessage) : onMessage(std::move(onMessage)), windowHandle([&] {
+			Window(FunctionRef<OnMessage> onMessage) : onMessage(onMessage), windowHandle([&] {
 				const auto windowHandle = ::CreateWindowW(windowClassName, L"LGTVDeviceListener DeviceListener", 0, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, HWND_MESSAGE, NULL, NULL, this);
 				if (windowHandle == NULL)
 					throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to create DeviceListener window");
@@ -93,7 +96,7 @@ namespace LGTVDeviceListener {
 				~WindowClassRegistration() { UnregisterClassW(windowClassName, NULL); }
 			};
 
-			const std::function<OnMessage> onMessage;
+			const FunctionRef<OnMessage> onMessage;
 			WindowClassRegistration windowClassRegistration;
 			const HWND windowHandle;
 		};
@@ -120,14 +123,15 @@ namespace LGTVDeviceListener {
 			const HDEVNOTIFY deviceNotificationHandle;
 		};
 
-		void RunWindowMessageLoop(HWND window) {
+		void RunWindowMessageLoop() {
 			for (;;) {
 				::MSG message;
-				switch (::GetMessage(&message, window, 0, 0)) {
+				// Note: we can't filter on the window here, as that would prevent us from ever seeing WM_QUIT, which is a thread message.
+				switch (::GetMessage(&message, NULL, 0, 0)) {
 				case -1:
 					throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to get DeviceListener window message");
 				case 0:
-					break;
+					return;
 				default:
 					::TranslateMessage(&message);
 					::DispatchMessage(&message);
@@ -138,9 +142,16 @@ namespace LGTVDeviceListener {
 	}
 
 	void ListenToDeviceEvents(
-		const std::function<void()>& onReady,
-		const std::function<void(DeviceEventType, std::wstring_view deviceName)>& onEvent) {
-		Window window([&](HWND, UINT messageIdentifier, WPARAM wParam, LPARAM lParam) {
+		std::stop_token stopToken,
+		FunctionRef<void()> onReady,
+		FunctionRef<void(DeviceEventType, std::wstring_view deviceName)> onEvent) {
+		// Stop requests typically come from another thread, so they are forwarded to the window thread through this message.
+		constexpr UINT stopMessageIdentifier = WM_APP;
+		const auto onWindowMessage = [&](HWND, UINT messageIdentifier, WPARAM wParam, LPARAM lParam) {
+			if (messageIdentifier == stopMessageIdentifier) {
+				::PostQuitMessage(0);
+				return;
+			}
 			if (messageIdentifier != WM_DEVICECHANGE) return;
 
 			DeviceEventType deviceEventType;
@@ -154,11 +165,51 @@ namespace LGTVDeviceListener {
 			if (deviceEventHeader.dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE) return;
 
 			const auto& deviceInterfaceEvent = reinterpret_cast<const ::DEV_BROADCAST_DEVICEINTERFACE_W&>(deviceEventHeader);
+			const Trace::Event traceEvent;
 			onEvent(deviceEventType, deviceInterfaceEvent.dbcc_name);
-		});
+		};
+		Window window(onWindowMessage);
 		DeviceNotificationRegistration deviceNotificationRegistration(window.GetWindowHandle());
+		const std::stop_callback stopCallback(stopToken, [&] {
+			if (::PostMessageW(window.GetWindowHandle(), stopMessageIdentifier, 0, 0) == 0)
+				Log(Log::Level::ERR) << L"Unable to post stop message to DeviceListener window [" << ::GetLastError() << L"]";
+		});
 		onReady();
-		RunWindowMessageLoop(window.GetWindowHandle());
+		RunWindowMessageLoop();
+	}
+
+	std::optional<GUID> GetDeviceInterfaceClass(std::wstring_view deviceName) {
+		const auto separator = deviceName.rfind(L'#');
+		if (separator == deviceName.npos) return std::nullopt;
+		// IIDFromString() wants a null-terminated string.
+		const std::wstring guidString(deviceName.substr(separator + 1));
+		GUID guid;
+		if (::IIDFromString(guidString.c_str(), &guid) != S_OK) return std::nullopt;
+		return guid;
+	}
+
+	std::vector<std::wstring> GetPresentDevices(const GUID& deviceInterfaceClass) {
+		std::vector<wchar_t> deviceInterfaceList;
+		for (;;) {
+			ULONG size;
+			const auto getSizeResult = ::CM_Get_Device_Interface_List_SizeW(&size, const_cast<GUID*>(&deviceInterfaceClass), NULL, CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+			if (getSizeResult != CR_SUCCESS)
+				throw std::runtime_error("Unable to get device interface list size [" + std::to_string(getSizeResult) + "]");
+
+			deviceInterfaceList.resize(size);
+			const auto getListResult = ::CM_Get_Device_Interface_ListW(const_cast<GUID*>(&deviceInterfaceClass), NULL, deviceInterfaceList.data(), size, CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+			// The list can grow between the two calls if a device is added in the meantime.
+			if (getListResult == CR_BUFFER_SMALL) continue;
+			if (getListResult != CR_SUCCESS)
+				throw std::runtime_error("Unable to get device interface list [" + std::to_string(getListResult) + "]");
+			break;
+		}
+
+		// The list is a sequence of null-terminated strings, terminated by an empty string.
+		std::vector<std::wstring> presentDevices;
+		for (auto deviceName = deviceInterfaceList.data(); *deviceName != L'\0'; deviceName += presentDevices.back().size() + 1)
+			presentDevices.emplace_back(deviceName);
+		return presentDevices;
 	}
 
 }
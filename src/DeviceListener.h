@@ -1,14 +1,29 @@
 #pragma once
 
-#include <functional>
+#include "DeviceEventType.h"
+#include "FunctionRef.h"
+
+#include <Windows.h>
+
+#include <optional>
+#include <stop_token>
 #include <string_view>
+#include <string>
+#include <vector>
 
 namespace LGTVDeviceListener {
 
-	enum class DeviceEventType { REMOVED, ADDED };
-
+	// Returns when stop is requested on `stopToken`.
 	void ListenToDeviceEvents(
-		const std::function<void()>& onReady,
-		const std::function<void(DeviceEventType, std::wstring_view deviceName)>& onEvent);
+		std::stop_token stopToken,
+		FunctionRef<void()> onReady,
+		FunctionRef<void(DeviceEventType, std::wstring_view deviceName)> onEvent);
+
+	// Device names typically end with the GUID of their device interface class, e.g. `\\?\USB#VID_1234&PID_5678#foo#{a5dcbf10-6530-11d2-901f-00c04fb951ed}`.
+	// Returns std::nullopt if the device name doesn't follow that pattern.
+	std::optional<GUID> GetDeviceInterfaceClass(std::wstring_view deviceName);
+
+	// Returns the names of the devices of the given device interface class that are currently present on the system.
+	std::vector<std::wstring> GetPresentDevices(const GUID& deviceInterfaceClass);
 
 }
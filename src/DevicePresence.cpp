@@ -0,0 +1,36 @@
+#include "DevicePresence.h"
+
+#include <algorithm>
+
+namespace LGTVDeviceListener {
+
+	bool DevicePresence::CaseInsensitiveLess::operator()(std::wstring_view lhs, std::wstring_view rhs) const {
+		return ::CompareStringOrdinal(lhs.data(), int(lhs.size()), rhs.data(), int(rhs.size()), /*bIgnoreCase=*/TRUE) == CSTR_LESS_THAN;
+	}
+
+	void DevicePresence::Update(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+		const auto present = deviceEventType == DeviceEventType::ADDED;
+		const auto device = devices.find(deviceName);
+		if (device != devices.end())
+			device->second = present;
+		else if (present)
+			devices.emplace(deviceName, true);
+	}
+
+	bool DevicePresence::IsPresent(std::wstring_view deviceName) {
+		LoadDeviceInterfaceClass(deviceName);
+		const auto device = devices.find(deviceName);
+		return device != devices.end() && device->second;
+	}
+
+	void DevicePresence::LoadDeviceInterfaceClass(std::wstring_view deviceName) {
+		const auto deviceInterfaceClass = GetDeviceInterfaceClass(deviceName);
+		if (!deviceInterfaceClass.has_value()) return;
+		if (std::find(loadedDeviceInterfaceClasses.begin(), loadedDeviceInterfaceClasses.end(), *deviceInterfaceClass) != loadedDeviceInterfaceClasses.end()) return;
+
+		for (auto&& presentDevice : GetPresentDevices(*deviceInterfaceClass))
+			devices.insert_or_assign(std::move(presentDevice), true);
+		loadedDeviceInterfaceClasses.push_back(*deviceInterfaceClass);
+	}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "DeviceListener.h"
+
+#include <Windows.h>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LGTVDeviceListener {
+
+	// Keeps track of which devices are currently present on the system.
+	//
+	// The initial state of a device interface class is loaded from the system the first time a device of that class is
+	// queried; device events are expected to be fed into Update() to keep the state current from then on.
+	class DevicePresence final {
+	public:
+		void Update(DeviceEventType, std::wstring_view deviceName);
+		bool IsPresent(std::wstring_view deviceName);
+
+	private:
+		// Device names are case-insensitive, and Windows is known to be inconsistent in the case it uses when reporting them.
+		struct CaseInsensitiveLess final {
+			using is_transparent = void;
+			bool operator()(std::wstring_view lhs, std::wstring_view rhs) const;
+		};
+
+		void LoadDeviceInterfaceClass(std::wstring_view deviceName);
+
+		// Maps every device seen so far to whether it is present. Devices are never removed from the map, so that devices
+		// coming and going repeatedly (e.g. a USB switch) don't cause an allocation every time.
+		std::map<std::wstring, bool, CaseInsensitiveLess> devices;
+		std::vector<GUID> loadedDeviceInterfaceClasses;
+	};
+
+}
@@ -0,0 +1,273 @@
+// Socket.h has to come first, see the note there.
+#include "Socket.h"
+
+#include "EventForwarding.h"
+
+#include "StringUtil.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <bcrypt.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace LGTVDeviceListener {
+
+	namespace {
+
+		constexpr char PACKET_MAGIC[4] = { 'L', 'G', 'E', 'F' };
+		constexpr uint8_t PACKET_VERSION = 1;
+		constexpr size_t MAXIMUM_DEVICE_NAME_SIZE = 1024;
+
+		// Packets that are older than this are dropped, which bounds the time window in which a captured packet could be
+		// replayed. This also has to accommodate the difference between the agent and controller clocks.
+		constexpr auto MAXIMUM_PACKET_AGE = std::chrono::seconds(30);
+
+		// A packet is made of this header, followed by the device name in UTF-8, followed by the HMAC-SHA256 tag of the
+		// header and device name. Integers are little-endian, as on all Windows platforms.
+		struct PacketHeader final {
+			char magic[4];
+			uint8_t version;
+			uint8_t eventType;
+			uint16_t deviceNameSize;
+			uint64_t sessionId;
+			uint64_t sequence;
+			int64_t unixTimeMilliseconds;
+		};
+		static_assert(sizeof(PacketHeader) == 32);
+
+		using Tag = std::array<uint8_t, 32>;
+		constexpr size_t MAXIMUM_PACKET_SIZE = sizeof(PacketHeader) + MAXIMUM_DEVICE_NAME_SIZE + std::tuple_size_v<Tag>;
+
+		Tag ComputeTag(std::string_view key, std::span<const char> data) {
+			Tag tag;
+			const auto status = ::BCryptHash(
+				BCRYPT_HMAC_SHA256_ALG_HANDLE,
+				reinterpret_cast<PUCHAR>(const_cast<char*>(key.data())), ULONG(key.size()),
+				reinterpret_cast<PUCHAR>(const_cast<char*>(data.data())), ULONG(data.size()),
+				tag.data(), ULONG(tag.size()));
+			if (!BCRYPT_SUCCESS(status))
+				throw std::runtime_error("Unable to compute HMAC [" + std::to_string(status) + "]");
+			return tag;
+		}
+
+		// Runs in constant time, so that the time it takes doesn't reveal how much of the tag is correct.
+		bool TagMatches(const Tag& expectedTag, std::span<const char> tag) {
+			uint8_t difference = 0;
+			for (size_t index = 0; index < expectedTag.size(); ++index)
+				difference |= expectedTag[index] ^ uint8_t(tag[index]);
+			return difference == 0;
+		}
+
+		int64_t GetUnixTimeMilliseconds() {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		struct ForwardedEvent final {
+			DeviceEventType deviceEventType;
+			uint64_t sessionId;
+			uint64_t sequence;
+			int64_t unixTimeMilliseconds;
+			std::string_view deviceName;
+		};
+
+		// Returns std::nullopt if the packet is malformed or its tag doesn't match.
+		std::optional<ForwardedEvent> ParsePacket(std::string_view key, std::span<const char> packet) {
+			PacketHeader header;
+			if (packet.size() < sizeof(header) + std::tuple_size_v<Tag>) return std::nullopt;
+			std::memcpy(&header, packet.data(), sizeof(header));
+			if (!std::equal(std::begin(PACKET_MAGIC), std::end(PACKET_MAGIC), std::begin(header.magic)) || header.version != PACKET_VERSION) return std::nullopt;
+			if (packet.size() != sizeof(header) + header.deviceNameSize + std::tuple_size_v<Tag>) return std::nullopt;
+
+			const auto signedData = packet.first(packet.size() - std::tuple_size_v<Tag>);
+			if (!TagMatches(ComputeTag(key, signedData), packet.last(std::tuple_size_v<Tag>))) return std::nullopt;
+			if (header.eventType > 1) return std::nullopt;
+
+			return ForwardedEvent{
+				.deviceEventType = header.eventType == 1 ? DeviceEventType::ADDED : DeviceEventType::REMOVED,
+				.sessionId = header.sessionId,
+				.sequence = header.sequence,
+				.unixTimeMilliseconds = header.unixTimeMilliseconds,
+				.deviceName = std::string_view(packet.data() + sizeof(header), header.deviceNameSize),
+			};
+		}
+
+		struct Destination final {
+			::sockaddr_storage address;
+			int addressSize;
+		};
+
+		Destination ResolveDestination(const std::string& destination) {
+			const auto separator = destination.rfind(':');
+			if (separator == destination.npos)
+				throw std::runtime_error("Forwarding destination must be of the form host:port: " + destination);
+			auto host = destination.substr(0, separator);
+			// Allow IPv6 addresses in the usual `[address]:port` form.
+			if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+			const auto port = destination.substr(separator + 1);
+
+			const ::ADDRINFOA hints = {
+				.ai_family = AF_UNSPEC,
+				.ai_socktype = SOCK_DGRAM,
+				.ai_protocol = IPPROTO_UDP,
+			};
+			::ADDRINFOA* addressInfo;
+			const auto error = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addressInfo);
+			if (error != 0)
+				throw std::system_error(std::error_code(error, std::system_category()), "Unable to resolve forwarding destination " + destination);
+			const std::unique_ptr<::ADDRINFOA, decltype(&::freeaddrinfo)> addressInfoDeleter(addressInfo, ::freeaddrinfo);
+
+			Destination result = { .addressSize = int(addressInfo->ai_addrlen) };
+			std::memcpy(&result.address, addressInfo->ai_addr, addressInfo->ai_addrlen);
+			return result;
+		}
+
+		uint64_t GenerateSessionId() {
+			std::random_device randomDevice;
+			return (uint64_t(randomDevice()) << 32) | randomDevice();
+		}
+
+	}
+
+	class EventForwarder::Sender final {
+	public:
+		Sender(const Options& options) :
+			key(options.key),
+			sessionId(GenerateSessionId()),
+			destination(ResolveDestination(options.destination)),
+			socket(destination.address.ss_family, SOCK_DGRAM, IPPROTO_UDP) {
+			packet.reserve(sizeof(PacketHeader) + 3 * MAXIMUM_DEVICE_NAME_SIZE + std::tuple_size_v<Tag>);
+		}
+
+		void Send(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+			// The UTF-8 encoding is never shorter than the UTF-16 one, so this is only a first check.
+			if (deviceName.size() > MAXIMUM_DEVICE_NAME_SIZE)
+				throw std::runtime_error("Device name is too long to be forwarded");
+
+			// Encode the device name in place, right after the header. The buffer was sized for the worst case upfront,
+			// so that this doesn't allocate.
+			packet.resize(sizeof(PacketHeader) + 3 * deviceName.size());
+			const auto deviceNameSize = EncodeUTF8(deviceName, std::span(packet).subspan(sizeof(PacketHeader)));
+			if (deviceNameSize > MAXIMUM_DEVICE_NAME_SIZE)
+				throw std::runtime_error("Device name is too long to be forwarded");
+			packet.resize(sizeof(PacketHeader) + deviceNameSize);
+
+			PacketHeader header = {
+				.version = PACKET_VERSION,
+				.eventType = uint8_t(deviceEventType == DeviceEventType::ADDED ? 1 : 0),
+				.deviceNameSize = uint16_t(deviceNameSize),
+				.sessionId = sessionId,
+				.sequence = nextSequence++,
+				.unixTimeMilliseconds = GetUnixTimeMilliseconds(),
+			};
+			std::copy(std::begin(PACKET_MAGIC), std::end(PACKET_MAGIC), header.magic);
+			std::memcpy(packet.data(), &header, sizeof(header));
+			const auto tag = ComputeTag(key, packet);
+			packet.insert(packet.end(), tag.begin(), tag.end());
+
+			// UDP doesn't guarantee delivery, so send the packet twice; the receiver ignores the duplicate.
+			for (int copy = 0; copy < 2; ++copy)
+				if (::sendto(socket.Get(), packet.data(), int(packet.size()), 0, reinterpret_cast<const ::sockaddr*>(&destination.address), destination.addressSize) == SOCKET_ERROR)
+					throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to send forwarded device event");
+		}
+
+	private:
+		WinsockInitializer winsockInitializer;
+		const std::string key;
+		const uint64_t sessionId;
+		const Destination destination;
+		const Socket socket;
+		uint64_t nextSequence = 0;
+		std::vector<char> packet;
+	};
+
+	EventForwarder::EventForwarder(const Options& options) : sender(std::make_unique<Sender>(options)) {}
+
+	EventForwarder::~EventForwarder() = default;
+
+	void EventForwarder::Forward(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+		const Trace::Span traceSpan("Event forwarding");
+		sender->Send(deviceEventType, deviceName);
+	}
+
+	void ReceiveForwardedEvents(
+		const EventReceiverOptions& options,
+		std::stop_token stopToken,
+		FunctionRef<void(DeviceEventType, std::wstring_view deviceName)> onEvent) {
+		WinsockInitializer winsockInitializer;
+		const Socket socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+
+		// Also accept IPv4 packets, which show up as coming from IPv4-mapped IPv6 addresses.
+		const DWORD ipv6Only = 0;
+		if (::setsockopt(socket.Get(), IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&ipv6Only), sizeof(ipv6Only)) != 0)
+			throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to enable IPv4 on forwarded event socket");
+		const ::sockaddr_in6 address = {
+			.sin6_family = AF_INET6,
+			.sin6_port = ::htons(options.port),
+		};
+		if (::bind(socket.Get(), reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0)
+			throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to bind forwarded event socket");
+		Log(Log::Level::INFO) << L"Listening for forwarded device events on UDP port " << options.port;
+
+		struct Session final {
+			uint64_t lastSequence;
+			std::chrono::steady_clock::time_point lastSeen;
+		};
+		std::map<uint64_t, Session> sessions;
+
+		char packet[MAXIMUM_PACKET_SIZE];
+		wchar_t deviceName[MAXIMUM_DEVICE_NAME_SIZE];
+		while (!stopToken.stop_requested()) {
+			// Wake up regularly to check for stop requests.
+			::fd_set readSet;
+			FD_ZERO(&readSet);
+			FD_SET(socket.Get(), &readSet);
+			const ::timeval selectTimeout = { .tv_sec = 0, .tv_usec = 100000 };
+			const auto selectResult = ::select(0, &readSet, NULL, NULL, &selectTimeout);
+			if (selectResult == SOCKET_ERROR)
+				throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to wait for forwarded device events");
+			if (selectResult == 0) continue;
+
+			// Note this fails with WSAEMSGSIZE on packets that are too large to be valid anyway.
+			const auto packetSize = ::recv(socket.Get(), packet, sizeof(packet), 0);
+			if (packetSize == SOCKET_ERROR) continue;
+
+			const auto forwardedEvent = ParsePacket(options.key, std::span(packet, packetSize));
+			if (!forwardedEvent.has_value()) {
+				Log(Log::Level::VERBOSE) << L"Ignoring malformed or unauthenticated forwarded device event";
+				continue;
+			}
+
+			const auto age = std::chrono::milliseconds(GetUnixTimeMilliseconds() - forwardedEvent->unixTimeMilliseconds);
+			if (age > MAXIMUM_PACKET_AGE || age < -MAXIMUM_PACKET_AGE) {
+				Log(Log::Level::WARNING) << L"Ignoring forwarded device event with a timestamp that is " << age.count() << L" ms off - are the clocks of both hosts synchronized?";
+				continue;
+			}
+
+			// Sessions that have been idle for long enough can be forgotten, because any packet from them would be too old.
+			const auto now = std::chrono::steady_clock::now();
+			std::erase_if(sessions, [&](const auto& session) { return now - session.second.lastSeen > 2 * MAXIMUM_PACKET_AGE; });
+
+			// Packets older than the latest one we processed are dropped: they are either duplicates, replays, or
+			// reordered packets that would otherwise undo the effect of a more recent event.
+			const auto [session, newSession] = sessions.try_emplace(forwardedEvent->sessionId);
+			if (!newSession && forwardedEvent->sequence <= session->second.lastSequence) {
+				Log(Log::Level::VERBOSE) << L"Ignoring duplicate or out-of-order forwarded device event";
+				continue;
+			}
+			session->second = { .lastSequence = forwardedEvent->sequence, .lastSeen = now };
+
+			const Trace::Event traceEvent;
+			onEvent(forwardedEvent->deviceEventType, std::wstring_view(deviceName, DecodeUTF8(forwardedEvent->deviceName, deviceName)));
+		}
+	}
+
+}
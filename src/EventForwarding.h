@@ -0,0 +1,56 @@
+#pragma once
+
+#include "DeviceListener.h"
+#include "FunctionRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <string_view>
+
+namespace LGTVDeviceListener {
+
+	// Device events can be forwarded from the host the device is plugged into (the "agent") to another host (the
+	// "controller") over UDP, one event per datagram.
+	//
+	// Datagrams are authenticated with HMAC-SHA256 using a key shared between the agent and the controller. They also
+	// carry a session ID (chosen randomly every time the agent starts), a sequence number and a timestamp, which the
+	// controller uses to drop duplicates, replays, and events that arrive after a more recent one.
+
+	class EventForwarder final {
+	public:
+		struct Options final {
+			// `host:port`, e.g. `192.168.1.10:3200`.
+			std::string destination;
+			std::string key;
+		};
+
+		EventForwarder(const Options&);
+		~EventForwarder();
+
+		EventForwarder(const EventForwarder&) = delete;
+		EventForwarder& operator=(const EventForwarder&) = delete;
+
+		// Not thread-safe.
+		void Forward(DeviceEventType, std::wstring_view deviceName);
+
+	private:
+		// Defined in the .cpp file to keep Winsock headers out of this one.
+		class Sender;
+
+		const std::unique_ptr<Sender> sender;
+	};
+
+	struct EventReceiverOptions final {
+		uint16_t port;
+		std::string key;
+	};
+
+	// Listens for events forwarded by EventForwarder on all interfaces. Returns when stop is requested on `stopToken`.
+	void ReceiveForwardedEvents(
+		const EventReceiverOptions&,
+		std::stop_token stopToken,
+		FunctionRef<void(DeviceEventType, std::wstring_view deviceName)> onEvent);
+
+}
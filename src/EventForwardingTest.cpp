@@ -0,0 +1,218 @@
+// Socket.h has to come first, see the note there.
+#include "Socket.h"
+
+#include "EventForwarding.h"
+
+#include <bcrypt.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Sends packets produced by EventForwarder, as is or tampered with, to ReceiveForwardedEvents() over the loopback
+// interface, and checks which ones come through.
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		constexpr std::string_view KEY = "key";
+		constexpr std::wstring_view DEVICE_NAME = L"\\\\?\\USB#VID_046D&PID_C52B&MI_00#7&2a8b3c4d&0&0000#{a5dcbf10-6530-11d2-901f-00c04fb951ed}";
+		constexpr std::wstring_view MARKER_DEVICE_NAME = L"Marker";
+
+		// The packet layout is part of the protocol between hosts, so it is spelled out here rather than shared with the
+		// implementation: the timestamp is a little-endian int64 at this offset, the device name follows the header, and
+		// the packet ends with an HMAC-SHA256 tag of everything before it.
+		constexpr size_t TIMESTAMP_OFFSET = 24;
+		constexpr size_t HEADER_SIZE = 32;
+		constexpr size_t TAG_SIZE = 32;
+
+		using Packet = std::vector<char>;
+
+		void Sign(Packet& packet, std::string_view key) {
+			const auto status = ::BCryptHash(
+				BCRYPT_HMAC_SHA256_ALG_HANDLE,
+				reinterpret_cast<PUCHAR>(const_cast<char*>(key.data())), ULONG(key.size()),
+				reinterpret_cast<PUCHAR>(packet.data()), ULONG(packet.size() - TAG_SIZE),
+				reinterpret_cast<PUCHAR>(packet.data() + packet.size() - TAG_SIZE), ULONG(TAG_SIZE));
+			if (!BCRYPT_SUCCESS(status))
+				throw std::runtime_error("Unable to compute HMAC [" + std::to_string(status) + "]");
+		}
+
+		::sockaddr_in GetLoopbackAddress(uint16_t port) {
+			::sockaddr_in address = { .sin_family = AF_INET, .sin_port = ::htons(port) };
+			address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+			return address;
+		}
+
+		uint16_t GetPort(const Socket& socket) {
+			::sockaddr_storage address;
+			int addressSize = sizeof(address);
+			if (::getsockname(socket.Get(), reinterpret_cast<::sockaddr*>(&address), &addressSize) != 0)
+				throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to get socket address");
+			// The port is at the same offset in IPv4 and IPv6 addresses.
+			return ::ntohs(reinterpret_cast<const ::sockaddr_in&>(address).sin_port);
+		}
+
+		class EventForwardingTest : public ::testing::Test {
+		protected:
+			struct Event final {
+				DeviceEventType deviceEventType;
+				std::wstring deviceName;
+			};
+
+			EventForwardingTest() {
+				const auto captureAddress = GetLoopbackAddress(0);
+				if (::bind(captureSocket.Get(), reinterpret_cast<const ::sockaddr*>(&captureAddress), sizeof(captureAddress)) != 0)
+					throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to bind capture socket");
+				eventForwarder.emplace(EventForwarder::Options{ .destination = "127.0.0.1:" + std::to_string(GetPort(captureSocket)), .key = std::string(KEY) });
+
+				// Find a free port for the receiver, which only takes a port number.
+				{
+					const Socket portSocket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+					const ::sockaddr_in6 address = { .sin6_family = AF_INET6 };
+					if (::bind(portSocket.Get(), reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) != 0)
+						throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to find a free port");
+					receiverPort = GetPort(portSocket);
+				}
+				receiverThread = std::jthread([this](std::stop_token stopToken) {
+					ReceiveForwardedEvents({ .port = receiverPort, .key = std::string(KEY) }, stopToken, [&](DeviceEventType deviceEventType, std::wstring_view deviceName) {
+						{
+							std::scoped_lock lock(mutex);
+							events.push_back({ deviceEventType, std::wstring(deviceName) });
+						}
+						eventReceived.notify_one();
+					});
+				});
+			}
+
+			void SetUp() override {
+				// The receiver might not be listening yet, so keep sending until something comes through.
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+				for (;;) {
+					Inject(Capture(DeviceEventType::ADDED, MARKER_DEVICE_NAME));
+					std::unique_lock lock(mutex);
+					if (eventReceived.wait_for(lock, std::chrono::milliseconds(100), [&] { return !events.empty(); })) break;
+					if (std::chrono::steady_clock::now() >= deadline) FAIL() << "Receiver didn't receive any events";
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				std::scoped_lock lock(mutex);
+				events.clear();
+			}
+
+			// Returns the packet EventForwarder sends for this event.
+			Packet Capture(DeviceEventType deviceEventType, std::wstring_view deviceName) {
+				eventForwarder->Forward(deviceEventType, deviceName);
+				Packet packet(2048);
+				// The packet is sent twice.
+				for (int copy = 0; copy < 2; ++copy) {
+					const auto packetSize = ::recv(captureSocket.Get(), packet.data(), int(packet.size()), 0);
+					if (packetSize == SOCKET_ERROR)
+						throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to capture forwarded event");
+					packet.resize(packetSize);
+				}
+				return packet;
+			}
+
+			void Inject(const Packet& packet) {
+				const auto address = GetLoopbackAddress(receiverPort);
+				if (::sendto(injectSocket.Get(), packet.data(), int(packet.size()), 0, reinterpret_cast<const ::sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR)
+					throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to inject packet");
+			}
+
+			// Sends a fresh, valid packet and waits for it, then returns all the events received so far, including the
+			// marker. Packets sent before the marker have been processed by then.
+			std::vector<Event> Flush() {
+				Inject(Capture(DeviceEventType::ADDED, MARKER_DEVICE_NAME));
+				std::unique_lock lock(mutex);
+				eventReceived.wait_for(lock, std::chrono::seconds(5), [&] { return !events.empty() && events.back().deviceName == MARKER_DEVICE_NAME; });
+				return std::exchange(events, {});
+			}
+
+			static bool IsMarker(const std::vector<Event>& events) {
+				return events.size() == 1 && events[0].deviceName == MARKER_DEVICE_NAME;
+			}
+
+			const WinsockInitializer winsockInitializer;
+			const Socket captureSocket{ AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+			const Socket injectSocket{ AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+			std::optional<EventForwarder> eventForwarder;
+			uint16_t receiverPort = 0;
+			std::mutex mutex;
+			std::condition_variable eventReceived;
+			std::vector<Event> events;
+			std::jthread receiverThread;
+		};
+
+		TEST_F(EventForwardingTest, AcceptsValidPacket) {
+			Inject(Capture(DeviceEventType::REMOVED, DEVICE_NAME));
+			const auto receivedEvents = Flush();
+			ASSERT_EQ(receivedEvents.size(), 2u);
+			EXPECT_EQ(receivedEvents[0].deviceEventType, DeviceEventType::REMOVED);
+			EXPECT_EQ(receivedEvents[0].deviceName, DEVICE_NAME);
+		}
+
+		TEST_F(EventForwardingTest, RejectsTamperedPacket) {
+			auto packet = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+			packet[HEADER_SIZE] ^= 1;
+			Inject(packet);
+			EXPECT_TRUE(IsMarker(Flush()));
+		}
+
+		TEST_F(EventForwardingTest, RejectsTamperedTag) {
+			auto packet = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+			packet.back() ^= 1;
+			Inject(packet);
+			EXPECT_TRUE(IsMarker(Flush()));
+		}
+
+		TEST_F(EventForwardingTest, RejectsWrongKey) {
+			auto packet = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+			Sign(packet, "wrong key");
+			Inject(packet);
+			EXPECT_TRUE(IsMarker(Flush()));
+		}
+
+		TEST_F(EventForwardingTest, RejectsReplay) {
+			const auto packet = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+			Inject(packet);
+			EXPECT_EQ(Flush().size(), 2u);
+			Inject(packet);
+			EXPECT_TRUE(IsMarker(Flush()));
+		}
+
+		TEST_F(EventForwardingTest, RejectsOutOfOrderPacket) {
+			const auto olderPacket = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+			const auto newerPacket = Capture(DeviceEventType::REMOVED, DEVICE_NAME);
+			Inject(newerPacket);
+			Inject(olderPacket);
+			const auto receivedEvents = Flush();
+			ASSERT_EQ(receivedEvents.size(), 2u);
+			EXPECT_EQ(receivedEvents[0].deviceEventType, DeviceEventType::REMOVED);
+		}
+
+		TEST_F(EventForwardingTest, RejectsPacketOutsideTimeWindow) {
+			for (const auto offset : { -std::chrono::minutes(1), std::chrono::minutes(1) }) {
+				auto packet = Capture(DeviceEventType::ADDED, DEVICE_NAME);
+				int64_t unixTimeMilliseconds;
+				std::memcpy(&unixTimeMilliseconds, packet.data() + TIMESTAMP_OFFSET, sizeof(unixTimeMilliseconds));
+				unixTimeMilliseconds += std::chrono::milliseconds(offset).count();
+				std::memcpy(packet.data() + TIMESTAMP_OFFSET, &unixTimeMilliseconds, sizeof(unixTimeMilliseconds));
+				Sign(packet, KEY);
+				Inject(packet);
+				EXPECT_TRUE(IsMarker(Flush())) << "offset " << offset.count() << " min";
+			}
+		}
+
+	}
+}
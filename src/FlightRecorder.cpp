@@ -0,0 +1,172 @@
+#include "FlightRecorder.h"
+
+#include "Trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace LGTVDeviceListener {
+
+	using FlightRecorderFormat::Header;
+	using FlightRecorderFormat::Record;
+
+#ifndef _WIN32
+	namespace {
+
+		// The file descriptor can be closed as soon as the file is mapped.
+		class FileDescriptor final {
+		public:
+			explicit FileDescriptor(int fileDescriptor) : fileDescriptor(fileDescriptor) {}
+			~FileDescriptor() { if (fileDescriptor >= 0) ::close(fileDescriptor); }
+
+			FileDescriptor(const FileDescriptor&) = delete;
+			FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+			int Get() const { return fileDescriptor; }
+
+		private:
+			const int fileDescriptor;
+		};
+
+	}
+#endif
+
+	void FlightRecorder::Initialize(const std::filesystem::path& path, uint32_t recordCount) {
+		if (state.has_value())
+			throw std::logic_error("Flight recorder initialized twice");
+		if (recordCount == 0)
+			throw std::invalid_argument("Flight recorder record count must be positive");
+
+		const uint64_t fileSize = sizeof(Header) + uint64_t(recordCount) * sizeof(Record);
+#ifdef _WIN32
+		// Other processes are allowed to read the file while we're running, so that it can be decoded at any time.
+		const auto fileHandle = ::CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to open flight recorder file");
+		UniqueHandle file(fileHandle);
+
+		// Note this extends the file if it's too small.
+		const auto fileMappingHandle = ::CreateFileMappingW(file.get(), NULL, PAGE_READWRITE, DWORD(fileSize >> 32), DWORD(fileSize), NULL);
+		if (fileMappingHandle == NULL)
+			throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to map flight recorder file");
+		UniqueHandle fileMapping(fileMappingHandle);
+
+		const auto viewPointer = ::MapViewOfFile(fileMapping.get(), FILE_MAP_WRITE, 0, 0, SIZE_T(fileSize));
+		if (viewPointer == NULL)
+			throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to map flight recorder file view");
+		std::unique_ptr<void, ViewDeleter> view(viewPointer);
+#else
+		const FileDescriptor fileDescriptor(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+		if (fileDescriptor.Get() < 0)
+			throw std::system_error(std::error_code(errno, std::system_category()), "Unable to open flight recorder file");
+
+		// Unlike CreateFileMapping(), mmap() doesn't extend the file, so do it ourselves. Note this never shrinks the file,
+		// which is consistent with the Windows behavior.
+		struct stat fileStatus;
+		if (::fstat(fileDescriptor.Get(), &fileStatus) != 0)
+			throw std::system_error(std::error_code(errno, std::system_category()), "Unable to query flight recorder file size");
+		if (uint64_t(fileStatus.st_size) < fileSize && ::ftruncate(fileDescriptor.Get(), off_t(fileSize)) != 0)
+			throw std::system_error(std::error_code(errno, std::system_category()), "Unable to extend flight recorder file");
+
+		const auto viewPointer = ::mmap(nullptr, size_t(fileSize), PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor.Get(), 0);
+		if (viewPointer == MAP_FAILED)
+			throw std::system_error(std::error_code(errno, std::system_category()), "Unable to map flight recorder file");
+		std::unique_ptr<void, ViewDeleter> view(viewPointer, ViewDeleter{ .size = size_t(fileSize) });
+#endif
+
+		auto& header = *static_cast<Header*>(view.get());
+		const std::span records(reinterpret_cast<Record*>(static_cast<std::byte*>(view.get()) + sizeof(Header)), recordCount);
+
+		// Start over if the file is new, or if it was written with a different layout.
+		if (!std::equal(std::begin(header.magic), std::end(header.magic), std::begin(FlightRecorderFormat::MAGIC)) ||
+			header.recordSize != sizeof(Record) || header.recordCount != recordCount) {
+			std::memset(view.get(), 0, size_t(fileSize));
+			std::copy(std::begin(FlightRecorderFormat::MAGIC), std::end(FlightRecorderFormat::MAGIC), header.magic);
+			header.recordSize = sizeof(Record);
+			header.recordCount = recordCount;
+		}
+
+		state.emplace(State{
+#ifdef _WIN32
+			.file = std::move(file),
+			.fileMapping = std::move(fileMapping),
+#endif
+			.view = std::move(view),
+			.header = &header,
+			.records = records,
+		});
+	}
+
+	namespace {
+
+		// Marks the text as truncated, given that the first `size` characters of the text were copied into `buffer`.
+		// Returns the size of the resulting text.
+		size_t WriteTruncationMarker(std::span<char> buffer, size_t size) {
+			std::copy(FlightRecorderFormat::TRUNCATION_MARKER.begin(), FlightRecorderFormat::TRUNCATION_MARKER.end(), buffer.begin() + size);
+			return size + FlightRecorderFormat::TRUNCATION_MARKER.size();
+		}
+
+	}
+
+	std::optional<FlightRecorder::State> FlightRecorder::state;
+
+#ifndef _WIN32
+	void FlightRecorder::ViewDeleter::operator()(void* view) const { ::munmap(view, size); }
+#endif
+
+	void FlightRecorder::Write(RecordType recordType, std::string_view text, std::optional<std::chrono::microseconds> latency) {
+		WriteRecord(recordType, latency, [&](std::span<char> buffer) {
+			if (text.size() <= buffer.size()) {
+				std::copy(text.begin(), text.end(), buffer.begin());
+				return text.size();
+			}
+			auto size = buffer.size() - FlightRecorderFormat::TRUNCATION_MARKER.size();
+			// Don't cut a UTF-8 sequence in half: back off to the lead byte of the sequence that doesn't fit.
+			while (size > 0 && (uint8_t(text[size]) & 0xC0) == 0x80) --size;
+			std::copy_n(text.begin(), size, buffer.begin());
+			return WriteTruncationMarker(buffer, size);
+		});
+	}
+
+	void FlightRecorder::Write(RecordType recordType, std::wstring_view text, std::optional<std::chrono::microseconds> latency) {
+		WriteRecord(recordType, latency, [&](std::span<char> buffer) {
+			const auto truncated = text.size() > buffer.size();
+			const auto size = truncated ? buffer.size() - FlightRecorderFormat::TRUNCATION_MARKER.size() : text.size();
+			std::transform(text.begin(), text.begin() + size, buffer.begin(), [](wchar_t character) {
+				return character < 0x80 ? char(character) : '?';
+			});
+			return truncated ? WriteTruncationMarker(buffer, size) : size;
+		});
+	}
+
+	void FlightRecorder::WriteRecord(RecordType recordType, std::optional<std::chrono::microseconds> latency, FunctionRef<size_t(std::span<char> text)> writeText) {
+		if (!state.has_value()) return;
+
+		const auto sequence = state->header->nextSequence.fetch_add(1, std::memory_order_relaxed);
+		auto& record = state->records[sequence % state->records.size()];
+
+		// Invalidate the record before touching it, so that a crash in the middle of writing it can't leave a garbled
+		// record behind. Note this doesn't protect against two threads writing the same record concurrently, but that
+		// would require the whole ring to wrap around in the meantime.
+		record.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		record.unixTimeMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		record.eventId = Trace::Event::GetCurrentId();
+		record.latencyMicroseconds = latency.has_value() ? latency->count() : -1;
+		record.type = recordType;
+		record.textSize = uint8_t(writeText(record.text));
+
+		record.sequence.store(sequence + 1, std::memory_order_release);
+	}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "FlightRecorderFormat.h"
+#include "FunctionRef.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace LGTVDeviceListener {
+
+	// Keeps compact records of the most recent device events, rule matches and TV requests in a memory-mapped ring buffer
+	// file. Because the file is mapped, records make it to disk even if the process crashes, so that the file can be
+	// inspected after the fact using LGTVFlightRecorderDecoder.
+	//
+	// Writing a record doesn't take any locks nor make any system calls, so it's cheap enough to do on every event.
+	// Records from previous runs are kept, as long as the record count doesn't change.
+	class FlightRecorder final {
+	public:
+		using RecordType = FlightRecorderFormat::RecordType;
+
+		static void Initialize(const std::filesystem::path&, uint32_t recordCount);
+
+		// Does nothing if the flight recorder is not initialized. The record is tagged with the current Trace::Event ID.
+		// Text that doesn't fit in a record is truncated (see FlightRecorderFormat::Record).
+		static void Write(RecordType, std::string_view text, std::optional<std::chrono::microseconds> latency = std::nullopt);
+		// Only meant for ASCII text, such as device names; other characters are replaced with '?'.
+		static void Write(RecordType, std::wstring_view text, std::optional<std::chrono::microseconds> latency = std::nullopt);
+
+	private:
+#ifdef _WIN32
+		struct HandleDeleter final {
+			void operator()(HANDLE handle) const { ::CloseHandle(handle); }
+		};
+		using UniqueHandle = std::unique_ptr<std::remove_pointer_t<HANDLE>, HandleDeleter>;
+
+		struct ViewDeleter final {
+			void operator()(void* view) const { ::UnmapViewOfFile(view); }
+		};
+#else
+		struct ViewDeleter final {
+			size_t size;
+			void operator()(void* view) const;
+		};
+#endif
+
+		struct State final {
+#ifdef _WIN32
+			UniqueHandle file;
+			UniqueHandle fileMapping;
+#endif
+			std::unique_ptr<void, ViewDeleter> view;
+			FlightRecorderFormat::Header* header;
+			std::span<FlightRecorderFormat::Record> records;
+		};
+		static std::optional<State> state;
+
+		// `writeText` copies the text into the given buffer and returns its size.
+		static void WriteRecord(RecordType, std::optional<std::chrono::microseconds> latency, FunctionRef<size_t(std::span<char> text)> writeText);
+	};
+
+}
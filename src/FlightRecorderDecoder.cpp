@@ -0,0 +1,81 @@
+#include "FlightRecorderFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		using FlightRecorderFormat::Header;
+		using FlightRecorderFormat::Record;
+
+		// Note: if the flight recorder file is being written to while we read it, the most recent record may be inconsistent.
+		void Decode(const char* path) {
+			std::ifstream file(path, std::ios::binary);
+			if (!file) throw std::runtime_error("Unable to open flight recorder file");
+			// Note the file can be larger than the records it holds, as FlightRecorder never shrinks it.
+			const auto fileSize = std::filesystem::file_size(path);
+
+			Header header;
+			if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) throw std::runtime_error("Flight recorder file is too small");
+			if (!std::equal(std::begin(header.magic), std::end(header.magic), std::begin(FlightRecorderFormat::MAGIC)))
+				throw std::runtime_error("Not a flight recorder file");
+			if (header.recordSize != sizeof(Record))
+				throw std::runtime_error("Unsupported flight recorder record size: " + std::to_string(header.recordSize));
+			// Checked before allocating anything, so that a corrupt header can't make us allocate gigabytes.
+			if (header.recordCount == 0 || fileSize < sizeof(header) + uint64_t(header.recordCount) * sizeof(Record))
+				throw std::runtime_error("Flight recorder file is truncated or corrupt: " + std::to_string(fileSize) + " bytes can't hold " + std::to_string(header.recordCount) + " records");
+
+			std::vector<Record> records(header.recordCount);
+			if (!file.read(reinterpret_cast<char*>(records.data()), std::streamsize(records.size() * sizeof(Record))))
+				throw std::runtime_error("Flight recorder file is truncated");
+
+			std::vector<const Record*> validRecords;
+			for (size_t index = 0; index < records.size(); ++index) {
+				const auto& record = records[index];
+				const auto sequence = record.sequence.load();
+				if (sequence == 0) continue;
+				// Each record lives at a fixed position in the ring. Note the header's next sequence number can't be used to
+				// validate records, as records may have been written after the header was read.
+				if ((sequence - 1) % records.size() != index || record.textSize > sizeof(record.text))
+					throw std::runtime_error("Flight recorder file is corrupt: invalid record at index " + std::to_string(index));
+				validRecords.push_back(&record);
+			}
+			std::sort(validRecords.begin(), validRecords.end(), [](const Record* lhs, const Record* rhs) {
+				return lhs->sequence.load() < rhs->sequence.load();
+			});
+
+			for (const auto record : validRecords) {
+				const auto time = std::chrono::sys_time<std::chrono::microseconds>(std::chrono::microseconds(record->unixTimeMicroseconds));
+				std::cout << std::format("{:%F %T} UTC #{} event={} {}", time, record->sequence.load() - 1, record->eventId, FlightRecorderFormat::GetRecordTypeName(record->type));
+				if (record->latencyMicroseconds >= 0)
+					std::cout << std::format(" ({} us)", record->latencyMicroseconds);
+				std::cout << ": " << std::string_view(record->text, record->textSize) << "\n";
+			}
+		}
+
+	}
+}
+
+int main(int argc, const char* const* argv) {
+	if (argc != 2) {
+		std::cerr << "Usage: LGTVFlightRecorderDecoder <flight recorder file>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		::LGTVDeviceListener::Decode(argv[1]);
+	}
+	catch (const std::exception& exception) {
+		std::cerr << "FATAL: " << exception.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
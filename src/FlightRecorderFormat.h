@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+namespace LGTVDeviceListener::FlightRecorderFormat {
+
+	// A flight recorder file is a Header followed by a ring buffer of `recordCount` Records. Records are written in
+	// sequence order, wrapping around once the ring is full; the oldest records are overwritten first.
+
+	constexpr char MAGIC[8] = { 'L', 'G', 'T', 'V', 'F', 'R', '0', '1' };
+
+	struct alignas(64) Header final {
+		char magic[8];
+		uint32_t recordSize;
+		uint32_t recordCount;
+		// Sequence number of the next record to be written.
+		std::atomic<uint64_t> nextSequence;
+	};
+
+	enum class RecordType : uint8_t { DEVICE_ADDED, DEVICE_REMOVED, RULE_MATCH, TV_REQUEST, TV_RESPONSE, TV_COMMAND_DONE, TV_COMMAND_FAILED };
+
+	struct Record final {
+		// Sequence number of the record plus one, or 0 if the record is empty or was being written when the process died.
+		std::atomic<uint64_t> sequence;
+		int64_t unixTimeMicroseconds;
+		// Correlation ID of the device event that caused this record (see Trace::Event), or 0 if none.
+		uint64_t eventId;
+		// Time taken by the operation this record describes, or -1 if not applicable.
+		int64_t latencyMicroseconds;
+		RecordType type;
+		uint8_t textSize;
+		// Not null-terminated. If it doesn't fit, it is truncated on a UTF-8 code point boundary and ends with
+		// TRUNCATION_MARKER.
+		char text[94];
+	};
+
+	static_assert(sizeof(Record) == 128);
+
+	constexpr std::string_view TRUNCATION_MARKER = "...";
+	static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+	inline std::string_view GetRecordTypeName(RecordType recordType) {
+		switch (recordType) {
+		case RecordType::DEVICE_ADDED: return "DEVICE_ADDED";
+		case RecordType::DEVICE_REMOVED: return "DEVICE_REMOVED";
+		case RecordType::RULE_MATCH: return "RULE_MATCH";
+		case RecordType::TV_REQUEST: return "TV_REQUEST";
+		case RecordType::TV_RESPONSE: return "TV_RESPONSE";
+		case RecordType::TV_COMMAND_DONE: return "TV_COMMAND_DONE";
+		case RecordType::TV_COMMAND_FAILED: return "TV_COMMAND_FAILED";
+		}
+		return "UNKNOWN";
+	}
+
+}
@@ -0,0 +1,52 @@
+#include "FlightRecorder.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		using FlightRecorderFormat::Header;
+		using FlightRecorderFormat::Record;
+
+		constexpr uint32_t RECORD_COUNT = 4;
+
+		// Returns the text of the records in the file, in ring order.
+		std::vector<std::string> ReadRecordTexts(const std::filesystem::path& path) {
+			std::ifstream file(path, std::ios::binary);
+			Header header;
+			file.read(reinterpret_cast<char*>(&header), sizeof(header));
+			std::vector<Record> records(RECORD_COUNT);
+			file.read(reinterpret_cast<char*>(records.data()), std::streamsize(records.size() * sizeof(Record)));
+			std::vector<std::string> texts;
+			for (const auto& record : records)
+				texts.emplace_back(record.text, record.textSize);
+			return texts;
+		}
+
+		// The flight recorder can only be initialized once per process, so this is a single test.
+		TEST(FlightRecorderTest, TruncatesText) {
+			const auto path = std::filesystem::temp_directory_path() / "LGTVDeviceListener-test.flight-recorder";
+			std::filesystem::remove(path);
+			FlightRecorder::Initialize(path, RECORD_COUNT);
+
+			const std::string fits(sizeof(Record::text), 'a');
+			FlightRecorder::Write(FlightRecorder::RecordType::TV_REQUEST, std::string_view(fits));
+			// "é" is 2 bytes in UTF-8, and straddles the point where the text gets cut.
+			const auto straddling = std::string(sizeof(Record::text) - FlightRecorderFormat::TRUNCATION_MARKER.size() - 1, 'a') + "\xC3\xA9" + std::string(10, 'b');
+			FlightRecorder::Write(FlightRecorder::RecordType::TV_REQUEST, std::string_view(straddling));
+			FlightRecorder::Write(FlightRecorder::RecordType::DEVICE_ADDED, std::wstring(sizeof(Record::text) + 1, L'a'));
+
+			const auto texts = ReadRecordTexts(path);
+			EXPECT_EQ(texts[0], fits);
+			EXPECT_EQ(texts[1], std::string(sizeof(Record::text) - FlightRecorderFormat::TRUNCATION_MARKER.size() - 1, 'a') + "...");
+			EXPECT_EQ(texts[2], std::string(sizeof(Record::text) - FlightRecorderFormat::TRUNCATION_MARKER.size(), 'a') + "...");
+		}
+
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace LGTVDeviceListener {
+
+	// Non-owning reference to a callable, similar to the proposed std::function_ref. Unlike std::function, constructing
+	// one never allocates, and calling it is a single indirect call with no null check.
+	//
+	// The referenced callable is not copied, so this is only suitable for callbacks that are not used after the function
+	// they were passed to returns. Callbacks that need to be stored (e.g. for asynchronous completion) should use
+	// std::function instead.
+	template <typename Signature> class FunctionRef;
+
+	template <typename Result, typename... Arguments>
+	class FunctionRef<Result(Arguments...)> final {
+	public:
+		template <typename Callable>
+			requires (!std::is_same_v<std::remove_cvref_t<Callable>, FunctionRef> && std::is_invocable_r_v<Result, Callable&, Arguments...>)
+		FunctionRef(Callable&& callable) :
+			callable(const_cast<void*>(static_cast<const void*>(std::addressof(callable)))),
+			invoke([](void* callable, Arguments... arguments) -> Result {
+				return static_cast<Result>(std::invoke(*static_cast<std::remove_reference_t<Callable>*>(callable), std::forward<Arguments>(arguments)...));
+			}) {}
+
+		Result operator()(Arguments... arguments) const { return invoke(callable, std::forward<Arguments>(arguments)...); }
+
+	private:
+		void* callable;
+		Result (*invoke)(void* callable, Arguments... arguments);
+	};
+
+}
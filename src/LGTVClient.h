@@ -1,9 +1,12 @@
 #pragma once
 
+#include "FunctionRef.h"
+#include "LGTVProtocol.h"
 #include "WebSocketClient.h"
 
 #include <nlohmann/json.hpp>
 
+#include <functional>
 #include <string>
 
 namespace LGTVDeviceListener {
@@ -23,22 +26,26 @@ namespace LGTVDeviceListener {
 
 		using OnRegistered = void(LGTVClient&, std::string_view clientKey);
 
-		static void Run(const std::string& url, const Options& options, const std::function<OnRegistered>& onRegistered);
+		// Returns when the connection is closed, or when stop is requested on `stopToken`.
+		// `onRegistered` is not used after Run() returns.
+		static void Run(const std::string& url, const Options& options, std::stop_token stopToken, FunctionRef<OnRegistered> onRegistered);
 
-		LGTVClient(ConstructorTag, WebSocketClient& webSocketClient, std::optional<std::string> clientKey, const std::function<OnRegistered>& onRegistered);
+		LGTVClient(ConstructorTag, WebSocketClient& webSocketClient, std::optional<std::string> clientKey, FunctionRef<OnRegistered> onRegistered);
 
 		void SetInput(std::string input, std::function<void()> onDone);
+
+		using OnCurrentInput = void(std::optional<std::string> input);
+
+		// Calls `onCurrentInput` with the ID of the input the TV is currently showing (e.g. `HDMI_1`), or std::nullopt if
+		// the TV is not showing an external input (e.g. an app is running) or the client key lacks the required permissions.
+		void GetCurrentInput(std::function<OnCurrentInput> onCurrentInput);
 		void Close();
 
 	private:
-		using OnResponse = bool(std::string type, nlohmann::json payload);
-
-		void IssueRequest(nlohmann::json request, std::function<OnResponse> onResponse);
-		void OnMessage(const nlohmann::json& message);
+		void IssueRequest(nlohmann::json request, std::function<LGTVProtocol::OnResponse> onResponse, std::function<LGTVProtocol::OnError> onError = nullptr);
 
 		WebSocketClient& webSocketClient;
-		uint32_t lastRequestId = 0;
-		std::unordered_map<uint32_t, std::function<OnResponse>> inflightRequests;
+		LGTVProtocol protocol;
 	};
 
 }
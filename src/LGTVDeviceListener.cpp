@@ -1,7 +1,14 @@
+#include "DeviceEventHandler.h"
 #include "DeviceListener.h"
+#include "EventForwarding.h"
+#include "FlightRecorder.h"
+#include "FunctionRef.h"
 #include "LGTVClient.h"
+#include "Rules.h"
+#include "TVController.h"
 #include "StringUtil.h"
 #include "Log.h"
+#include "Trace.h"
 
 #include <cxxopts.hpp>
 
@@ -10,6 +17,11 @@
 #include <aclapi.h>
 #include <sddl.h>
 
+#include <atomic>
+#include <chrono>
+#include <stop_token>
+#include <thread>
+
 namespace LGTVDeviceListener {
 	namespace {
 
@@ -17,6 +29,9 @@ namespace LGTVDeviceListener {
 		constexpr auto SERVICE_NAME = L"LGTVDeviceListener";
 		constexpr auto SERVICE_SID = L"S-1-5-80-1465594813-3926234551-4209042125-1279866487-3944004573";
 
+		// 512 KiB worth of records.
+		constexpr uint32_t FLIGHT_RECORDER_RECORD_COUNT = 4096;
+
 		enum class RunMode { CONSOLE, SERVICE };
 
 		// Made global because otherwise it's difficult to get to while running as a service.
@@ -34,13 +49,23 @@ namespace LGTVDeviceListener {
 			bool showHelp = false;
 			std::optional<std::string> url;
 			std::optional<std::string> clientKeyFile;
+			std::optional<std::string> tvId;
+			std::optional<std::string> tvCacheFile;
 			std::optional<std::string> deviceName;
 			std::optional<std::string> addInput;
 			std::optional<std::string> removeInput;
+			std::optional<std::string> rulesFile;
+			bool applyOnStart = false;
 			bool createService = false;
 			bool verbose = false;
-			int connectTimeoutSeconds = WebSocketClient::Options().connectTimeoutSeconds;
-			int handshakeTimeoutSeconds = WebSocketClient::Options().handshakeTimeoutSeconds;
+			std::optional<std::string> traceFile;
+			std::optional<std::string> flightRecorderFile;
+			std::optional<std::string> forwardTo;
+			std::optional<int> receivePort;
+			std::optional<std::string> forwardingKey;
+			int connectTimeoutSeconds = int(std::chrono::duration_cast<std::chrono::seconds>(WebSocketClient::Options().connectTimeout).count());
+			int handshakeTimeoutSeconds = int(std::chrono::duration_cast<std::chrono::seconds>(WebSocketClient::Options().handshakeTimeout).count());
+			bool probeBeforeConnect = false;
 		};
 
 		std::optional<Options> ParseCommandLine(RunMode runMode) {
@@ -50,13 +75,23 @@ namespace LGTVDeviceListener {
 				("h,help", "Show this help message", ::cxxopts::value(options.showHelp))
 				("url", "URL of the LGTV websocket. For example `ws://192.168.1.42:3000`. If not specified, log what would have been done instead", ::cxxopts::value(options.url))
 				("client-key-file", R"(Path to the file holding the LGTV client key. If the file doesn't exist, a new client key will be registered and written to the file (default: %ProgramData%\LGTVDeviceListener.client-key))", ::cxxopts::value(options.clientKeyFile))
+				("tv-id", "ID of the LGTV to look for on the local network, as logged during discovery. When specified, the host in --url is replaced with the address the TV was last discovered at, so that the TV can be found even if its IP address changes", ::cxxopts::value(options.tvId))
+				("tv-cache-file", R"(Path to the file remembering where LGTVs were last discovered, for use with --tv-id (default: %ProgramData%\LGTVDeviceListener.tv-cache.json))", ::cxxopts::value(options.tvCacheFile))
 				("device-name", R"(The name of the device to watch. Typically starts with `\\?\`. If not specified, log events from all devices)", ::cxxopts::value(options.deviceName))
 				("add-input", "Which TV input to switch to when the device is added. For example `HDMI_1`. If not specified, does nothing on add", ::cxxopts::value(options.addInput))
 				("remove-input", "Which TV input to switch to when the device is removed. For example `HDMI_2`. If not specified, does nothing on remove", ::cxxopts::value(options.removeInput))
+				("apply-on-start", "On startup, immediately switch to the add input if the device is present, or to the remove input if it is absent, instead of waiting for the next device event. With --receive-port, a device absent locally is left alone, as it might be plugged into the forwarding host", ::cxxopts::value(options.applyOnStart))
+				("rules-file", "Path to a JSON file providing the device name, add input and remove input, as an alternative to the corresponding options. The file is reloaded automatically when it changes", ::cxxopts::value(options.rulesFile))
 				("create-service", "Create a Windows service that runs with the other provided arguments, then start it", ::cxxopts::value(options.createService))
 				("verbose", "Enable verbose logging", ::cxxopts::value(options.verbose))
-				("connect-timeout-seconds", "How long to wait for the WebSocket connection to establish, in seconds (default: " + std::to_string(Options().connectTimeoutSeconds) + ")", ::cxxopts::value(options.connectTimeoutSeconds))
-				("handshake-timeout-seconds", "How long to wait for the WebSocket handshake to complete, in seconds (default: " + std::to_string(Options().handshakeTimeoutSeconds) + ")", ::cxxopts::value(options.handshakeTimeoutSeconds));
+				("trace-file", "Write a timeline of the processing of each device event to this file, in Chrome Trace Event Format. The file can be opened in chrome://tracing or https://ui.perfetto.dev", ::cxxopts::value(options.traceFile))
+				("flight-recorder-file", "Continuously record the most recent device events and LGTV requests in this file, so that they can be inspected after a crash using LGTVFlightRecorderDecoder", ::cxxopts::value(options.flightRecorderFile))
+				("forward-to", "Forward device events to another LGTVDeviceListener instance running with --receive-port, given as `host:port`. Requires --forwarding-key", ::cxxopts::value(options.forwardTo))
+				("receive-port", "Listen on this UDP port for device events forwarded by other LGTVDeviceListener instances, and handle them as if they happened locally. Requires --forwarding-key", ::cxxopts::value(options.receivePort))
+				("forwarding-key", "Secret shared by the instances forwarding and receiving device events, used to authenticate forwarded events", ::cxxopts::value(options.forwardingKey))
+				("connect-timeout-seconds", "Maximum time to wait for the WebSocket connection to establish, in seconds. Also bounds the reachability check of --probe-before-connect (default: " + std::to_string(Options().connectTimeoutSeconds) + ")", ::cxxopts::value(options.connectTimeoutSeconds))
+				("handshake-timeout-seconds", "How long to wait for the WebSocket handshake to complete, in seconds. This timeout is fixed (default: " + std::to_string(Options().handshakeTimeoutSeconds) + ")", ::cxxopts::value(options.handshakeTimeoutSeconds))
+				("probe-before-connect", "Start each connection attempt with a quick TCP reachability check, whose timeout is adjusted based on observed network round-trip times, so that an unreachable TV is detected faster. Costs one extra round trip per connection when the TV is reachable", ::cxxopts::value(options.probeBeforeConnect));
 			try {
 				cxxoptsOptions.parse(argc, argv);
 			}
@@ -86,7 +121,7 @@ namespace LGTVDeviceListener {
 		template <typename T>
 		using UniqueHeapPtr = std::unique_ptr<T, LocalHeapDeleter>;
 
-		std::wstring GetClientKeyPath(const std::optional<std::string>& file) {
+		std::wstring GetProgramDataPath(const std::optional<std::string>& file, std::wstring_view defaultFileName) {
 			if (file.has_value()) return ToWideString(*file, CP_ACP);
 			PWSTR path = NULL;
 			const auto hresult = ::SHGetKnownFolderPath(FOLDERID_ProgramData, 0, NULL, &path);
@@ -94,7 +129,7 @@ namespace LGTVDeviceListener {
 				::CoTaskMemFree(path);
 				throw std::runtime_error("Unable to get ProgramData folder path [" + std::to_string(hresult) + "]");
 			}
-			auto pathString = std::wstring(path) + LR"(\LGTVDeviceListener.client-key)";
+			auto pathString = std::wstring(path) + L"\\" + std::wstring(defaultFileName);
 			::CoTaskMemFree(path);
 			return pathString;
 		}
@@ -259,16 +294,25 @@ namespace LGTVDeviceListener {
 			Log(Log::Level::INFO) << L"Service has been created and started. Any messages/errors from the service will be sent to the Windows Application Event Log.";
 		}
 
-		void RunDeviceListener(const Options& options, const std::function<void()>& onReady) {
+		// `onMaximumStopTime` is called whenever the upper bound on how long it takes to stop after `stopToken` is signaled changes.
+		void RunDeviceListener(const Options& options, std::stop_token stopToken, FunctionRef<void()> onReady, FunctionRef<void(std::chrono::milliseconds)> onMaximumStopTime) {
+			if (options.traceFile.has_value())
+				Trace::Initialize(ToWideString(*options.traceFile, CP_ACP));
+			if (options.flightRecorderFile.has_value())
+				FlightRecorder::Initialize(ToWideString(*options.flightRecorderFile, CP_ACP), FLIGHT_RECORDER_RECORD_COUNT);
+
 			const WebSocketClient::Options webSocketClientOptions = {
-				.connectTimeoutSeconds = options.connectTimeoutSeconds,
-				.handshakeTimeoutSeconds = options.handshakeTimeoutSeconds,
-				.tlsOptions = [] { ix::SocketTLSOptions tlsOptions; tlsOptions.caFile = "NONE"; return tlsOptions; }()
+				.connectTimeout = std::chrono::seconds(options.connectTimeoutSeconds),
+				.handshakeTimeout = std::chrono::seconds(options.handshakeTimeoutSeconds),
+				.tlsOptions = [] { ix::SocketTLSOptions tlsOptions; tlsOptions.caFile = "NONE"; return tlsOptions; }(),
+				.probe = options.probeBeforeConnect,
 			};
+			if (options.url.has_value())
+				onMaximumStopTime(WebSocketClient::GetMaximumStopTime(webSocketClientOptions));
 
 			std::optional<std::string> clientKey;
 			if (options.url.has_value()) {
-				const auto clientKeyPath = GetClientKeyPath(options.clientKeyFile);
+				const auto clientKeyPath = GetProgramDataPath(options.clientKeyFile, L"LGTVDeviceListener.client-key");
 				Log(Log::Level::VERBOSE) << L"Using client key file: " << clientKeyPath;
 				clientKey = ReadClientKey(clientKeyPath);
 				if (clientKey.has_value())
@@ -276,60 +320,101 @@ namespace LGTVDeviceListener {
 				else {
 					Log(Log::Level::INFO) << L"Client key file not found - registering new client key with LGTV";
 					LGTVClient::Run(
-						*options.url, { .webSocketClientOptions = webSocketClientOptions },
+						*options.url, { .webSocketClientOptions = webSocketClientOptions }, stopToken,
 						[&](LGTVClient& lgtvClient, std::string_view newClientKey) {
 							Log(Log::Level::INFO) << "New LGTV client key successfully obtained";
 							clientKey = newClientKey;
 							lgtvClient.Close();
 						});
+					if (!clientKey.has_value()) {
+						if (stopToken.stop_requested()) return;
+						throw std::runtime_error("LGTV connection closed before client key could be obtained");
+					}
 					WriteClientKey(clientKeyPath, *clientKey);
 				}
 			}
 
-			const auto expectedDeviceName = options.deviceName.has_value() ? std::optional<std::wstring>(ToWideString(*options.deviceName, CP_ACP)) : std::nullopt;
+			// Commands are sent from a separate thread, so that the event handler never has to wait for the TV.
+			std::optional<TVController> tvController;
+			if (options.url.has_value())
+				tvController.emplace(TVController::Options{
+					.url = *options.url,
+					.lgtvClientOptions = { .clientKey = clientKey, .webSocketClientOptions = webSocketClientOptions },
+					.tvLocatorOptions = options.tvId.has_value() ? std::optional<TVLocator::Options>(TVLocator::Options{
+						.tvId = *options.tvId,
+						.cacheFile = GetProgramDataPath(options.tvCacheFile, L"LGTVDeviceListener.tv-cache.json"),
+					}) : std::nullopt,
+				});
+			else if (options.tvId.has_value())
+				throw std::runtime_error("--tv-id requires --url");
+			if (tvController.has_value())
+				onMaximumStopTime(tvController->GetMaximumStopTime());
+
+			// The event handler only ever sees an immutable snapshot of the rules, so that reloading them never blocks event processing.
+			std::atomic<std::shared_ptr<const Rules>> currentRules;
+			std::optional<RulesFileWatcher> rulesFileWatcher;
+			if (options.rulesFile.has_value()) {
+				if (options.deviceName.has_value() || options.addInput.has_value() || options.removeInput.has_value())
+					throw std::runtime_error("--rules-file cannot be combined with --device-name, --add-input or --remove-input");
+				const auto rulesFilePath = ToWideString(*options.rulesFile, CP_ACP);
+				currentRules = std::make_shared<const Rules>(LoadRulesFile(rulesFilePath));
+				rulesFileWatcher.emplace(rulesFilePath, [&](Rules rules) {
+					currentRules = std::make_shared<const Rules>(std::move(rules));
+					Log(Log::Level::INFO) << L"New rules loaded";
+				});
+			}
+			else
+				currentRules = std::make_shared<const Rules>(Rules{
+					.deviceName = options.deviceName.has_value() ? std::optional<std::wstring>(ToWideString(*options.deviceName, CP_ACP)) : std::nullopt,
+					.addInput = options.addInput,
+					.removeInput = options.removeInput,
+				});
+
+			if (options.forwardingKey.has_value() && options.forwardingKey->empty())
+				throw std::runtime_error("--forwarding-key cannot be empty");
+
+			std::optional<EventForwarder> eventForwarder;
+			if (options.forwardTo.has_value()) {
+				if (!options.forwardingKey.has_value())
+					throw std::runtime_error("--forward-to requires --forwarding-key");
+				eventForwarder.emplace(EventForwarder::Options{ .destination = *options.forwardTo, .key = *options.forwardingKey });
+			}
+
+			DeviceEventHandler deviceEventHandler(currentRules, tvController.has_value() ? &*tvController : nullptr, eventForwarder.has_value() ? &*eventForwarder : nullptr);
+
+			std::optional<std::jthread> eventReceiverThread;
+			if (options.receivePort.has_value()) {
+				if (!options.forwardingKey.has_value())
+					throw std::runtime_error("--receive-port requires --forwarding-key");
+				if (*options.receivePort < 1 || *options.receivePort > 65535)
+					throw std::runtime_error("--receive-port must be between 1 and 65535");
+				eventReceiverThread.emplace([&, eventReceiverOptions = EventReceiverOptions{ .port = uint16_t(*options.receivePort), .key = *options.forwardingKey }](std::stop_token receiverStopToken) {
+					try {
+						ReceiveForwardedEvents(eventReceiverOptions, receiverStopToken, [&](DeviceEventType deviceEventType, std::wstring_view deviceName) {
+							deviceEventHandler.OnForwardedEvent(deviceEventType, deviceName);
+						});
+					}
+					catch (const std::exception& exception) {
+						Log(Log::Level::ERR) << L"Stopped receiving forwarded device events due to error: " << ToWideString(exception.what(), CP_ACP);
+					}
+				});
+			}
+
 			ListenToDeviceEvents(
+				stopToken,
 				[&]{
 					Log(Log::Level::INFO) << L"Listening for device events";
+					// Note we only look at the current device state after we started listening for device events, so that we can't miss any changes.
+					if (options.applyOnStart) deviceEventHandler.ApplyOnStart(/*receivingForwardedEvents=*/options.receivePort.has_value());
 					onReady();
 				},
 				[&](DeviceEventType deviceEventType, std::wstring_view deviceName) {
-				const auto deviceEventTypeString = [&] {
-						switch (deviceEventType) {
-						case DeviceEventType::ADDED: return L"added";
-						case DeviceEventType::REMOVED: return L"removed";
-						}
-						::abort();
-				}();
-
-				Log(!expectedDeviceName.has_value() ? Log::Level::INFO : Log::Level::VERBOSE) << L"Device " << deviceEventTypeString << L": " << deviceName;
-
-				if (deviceName != expectedDeviceName) return;
-
-				const auto input = [&] {
-					switch (deviceEventType) {
-					case DeviceEventType::ADDED: return options.addInput;
-					case DeviceEventType::REMOVED: return options.removeInput;
-					}
-					::abort();
-				}();
-				if (!input.has_value()) {
-					Log(Log::Level::INFO) << "Device " << deviceEventTypeString << "; ignoring since no TV input to switch to was specified for this event";
-					return;
-				}
-
-				const auto loggingOnly = !options.url.has_value();
-				Log(Log::Level::INFO) << "Device " << deviceEventTypeString << "; " << (loggingOnly ? L"would have switched" : L"switching") << L" LGTV to input: " << ToWideString(*input, CP_UTF8);
-				if (loggingOnly) return;
-
-				LGTVClient::Run(
-					*options.url, { .clientKey = clientKey, .webSocketClientOptions = webSocketClientOptions },
-					[&](LGTVClient& lgtvClient, std::string_view) {
-						lgtvClient.SetInput(*input, [&] { lgtvClient.Close(); });
-					});
-			});
+					deviceEventHandler.OnLocalEvent(deviceEventType, deviceName);
+				});
+			Log(Log::Level::INFO) << L"Stopped listening for device events";
 		}
 
-		int Run(RunMode runMode, const std::function<void()>& onReady = [] {}) {
+		int Run(RunMode runMode, std::stop_token stopToken, FunctionRef<void()> onReady = [] {}, FunctionRef<void(std::chrono::milliseconds)> onMaximumStopTime = [](std::chrono::milliseconds) {}) {
 			const auto options = ::LGTVDeviceListener::ParseCommandLine(runMode);
 			if (!options.has_value()) return EXIT_FAILURE;
 			if (options->showHelp) return EXIT_SUCCESS;
@@ -339,7 +424,7 @@ namespace LGTVDeviceListener {
 				if (options->createService && runMode != RunMode::SERVICE)
 					CreateService();
 				else
-					RunDeviceListener(*options, onReady);
+					RunDeviceListener(*options, std::move(stopToken), onReady, onMaximumStopTime);
 			}
 			catch (const std::exception& exception) {
 				Log(Log::Level::ERR) << "FATAL: " << ToWideString(exception.what(), CP_ACP);
@@ -357,15 +442,25 @@ namespace LGTVDeviceListener {
 			}
 
 			~ServiceControlHandler() {
-				// This means the service thread is unwinding, which currently always means an error occurred.
+				// This means the service thread is unwinding, which means we were asked to stop or an error occurred.
 				// In any case, we *have* to send SERVICE_STOPPED because any further control requests will hit a destroyed ServiceControlHandler object.
-				SetStatus(SERVICE_STOPPED, 0, true);
+				SetStatus(SERVICE_STOPPED, 0, !stopSource.stop_requested() || exitCode != EXIT_SUCCESS);
 			}
 
+			std::stop_token GetStopToken() const { return stopSource.get_token(); }
+
 			void OnReady() {
 				SetStatus(SERVICE_RUNNING, SERVICE_ACCEPT_STOP);
 			}
 
+			void OnMaximumStopTime(std::chrono::milliseconds maximumStopTime) {
+				stopWaitHint = BASE_STOP_WAIT_HINT + maximumStopTime;
+			}
+
+			void OnExit(int exitCode) {
+				this->exitCode = exitCode;
+			}
+
 		private:
 			static DWORD WINAPI Handler(DWORD control, DWORD eventType, LPVOID eventData, LPVOID context) {
 				return static_cast<ServiceControlHandler*>(context)->Handle(control, eventType, eventData);
@@ -375,13 +470,20 @@ namespace LGTVDeviceListener {
 				switch (control) {
 				case SERVICE_CONTROL_INTERROGATE: return NO_ERROR;
 				case SERVICE_CONTROL_STOP:
-					SetStatus(SERVICE_STOPPED, 0);
+					// The service thread will send SERVICE_STOPPED once it's done unwinding.
+					SetStatus(SERVICE_STOP_PENDING, 0, false, DWORD(stopWaitHint.load().count()));
+					stopSource.request_stop();
 					return NO_ERROR;
 				default: return ERROR_CALL_NOT_IMPLEMENTED;
 				}
 			}
 
-			void SetStatus(DWORD currentState, DWORD controlsAccepted, bool error = false) {
+			// How long stopping takes when there is no LGTV connection attempt to wait for. Stopping can take as long as an
+			// ongoing connection attempt, which is added to this once the configured timeouts are known.
+			// Note the service control manager doesn't forcibly terminate the service if this expires, it just reports it as hung.
+			static constexpr auto BASE_STOP_WAIT_HINT = std::chrono::seconds(3);
+
+			void SetStatus(DWORD currentState, DWORD controlsAccepted, bool error = false, DWORD waitHint = 0) {
 				SERVICE_STATUS serviceStatus = {
 					.dwServiceType = SERVICE_USER_OWN_PROCESS,
 					.dwCurrentState = currentState,
@@ -391,19 +493,25 @@ namespace LGTVDeviceListener {
 					.dwWin32ExitCode = error ? DWORD(ERROR_SERVICE_SPECIFIC_ERROR) : NO_ERROR,
 					.dwServiceSpecificExitCode = error ? DWORD(ERROR_SERVICE_SPECIFIC_ERROR) : 0,
 					.dwCheckPoint = 0,
-					.dwWaitHint = 0,
+					.dwWaitHint = waitHint,
 				};
 				if (SetServiceStatus(serviceStatusHandle, &serviceStatus) == 0)
 					throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to set service status");
 			}
 
+			std::stop_source stopSource;
+			// Read from the service control handler thread.
+			std::atomic<std::chrono::milliseconds> stopWaitHint{ BASE_STOP_WAIT_HINT };
+			int exitCode = EXIT_FAILURE;
 			const SERVICE_STATUS_HANDLE serviceStatusHandle = RegisterServiceCtrlHandlerExW(SERVICE_NAME, Handler, this);
 		};
 
 		VOID WINAPI RunService(DWORD, LPTSTR*) {
 			try {
 				ServiceControlHandler serviceControlHandler;
-				Run(RunMode::SERVICE, [&] { serviceControlHandler.OnReady(); });
+				serviceControlHandler.OnExit(Run(RunMode::SERVICE, serviceControlHandler.GetStopToken(),
+					[&] { serviceControlHandler.OnReady(); },
+					[&](std::chrono::milliseconds maximumStopTime) { serviceControlHandler.OnMaximumStopTime(maximumStopTime); }));
 			}
 			catch (const std::exception& exception) {
 				InitializeLog(RunMode::SERVICE);
@@ -411,6 +519,20 @@ namespace LGTVDeviceListener {
 			}
 		}
 
+		std::stop_source consoleStopSource;
+
+		BOOL WINAPI HandleConsoleControl(DWORD controlType) {
+			if (controlType != CTRL_C_EVENT && controlType != CTRL_BREAK_EVENT) return FALSE;
+			// If we were already asked to stop, let the default handler terminate the process.
+			return consoleStopSource.request_stop() ? TRUE : FALSE;
+		}
+
+		int RunConsole() {
+			if (::SetConsoleCtrlHandler(HandleConsoleControl, TRUE) == 0)
+				throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to set console control handler");
+			return Run(RunMode::CONSOLE, consoleStopSource.get_token());
+		}
+
 	}
 }
 
@@ -428,7 +550,7 @@ int main(int argc, const char* const* argv) {
 		if (serviceDispatcherError != ERROR_FAILED_SERVICE_CONTROLLER_CONNECT)
 			throw std::system_error(std::error_code(serviceDispatcherError, std::system_category()), "Unable to start service dispatcher");
 
-		return ::LGTVDeviceListener::Run(::LGTVDeviceListener::RunMode::CONSOLE);
+		return ::LGTVDeviceListener::RunConsole();
 	}
 	catch (const std::exception& exception) {
 		std::cerr << "FATAL ERROR: " << exception.what() << std::endl;
@@ -0,0 +1,119 @@
+﻿#include "LGTVProtocol.h"
+
+#include "FlightRecorder.h"
+#include "Trace.h"
+
+#include <stdexcept>
+
+namespace LGTVDeviceListener {
+
+	nlohmann::json GetRegisterRequest(std::optional<std::string> clientKey) {
+		return {
+			{"type", "register"},
+			{"payload", clientKey.has_value() ?
+				nlohmann::json({{"client-key", *std::move(clientKey)}}) :
+				// Shamelessly stolen from aiopylgtv
+				nlohmann::json({{"manifest", {
+					{"permissions", {"LAUNCH", "READ_INPUT_DEVICE_LIST", "READ_RUNNING_APPS"}},
+					{"signatures", {{
+						{"signature",
+							"eyJhbGdvcml0aG0iOiJSU0EtU0hBMjU2Iiwia2V5SWQiOiJ0ZXN0LXNpZ25pbm"
+							"ctY2VydCIsInNpZ25hdHVyZVZlcnNpb24iOjF9.hrVRgjCwXVvE2OOSpDZ58hR"
+							"+59aFNwYDyjQgKk3auukd7pcegmE2CzPCa0bJ0ZsRAcKkCTJrWo5iDzNhMBWRy"
+							"aMOv5zWSrthlf7G128qvIlpMT0YNY+n/FaOHE73uLrS/g7swl3/qH/BGFG2Hu4"
+							"RlL48eb3lLKqTt2xKHdCs6Cd4RMfJPYnzgvI4BNrFUKsjkcu+WD4OO2A27Pq1n"
+							"50cMchmcaXadJhGrOqH5YmHdOCj5NSHzJYrsW0HPlpuAx/ECMeIZYDh6RMqaFM"
+							"2DXzdKX9NmmyqzJ3o/0lkk/N97gfVRLW5hA29yeAwaCViZNCP8iC9aO0q9fQoj"
+							"oa7NQnAtw=="
+						},
+						{"signatureVersion", 1}}}},
+					{"signed", {
+						{"appId", "com.lge.test"},
+						{"created", "20140509"},
+						{"localizedAppNames", {
+							{"", "LG Remote App"},
+							{"ko-KR", "리모컨 앱"},
+							{"zxx-XX", "ЛГ Rэмotэ AПП"},
+						}},
+						{"localizedVendorNames", {{"", "LG Electronics"}}},
+						{"permissions", {
+							"TEST_SECURE",
+							"CONTROL_INPUT_TEXT",
+							"CONTROL_MOUSE_AND_KEYBOARD",
+							"READ_INSTALLED_APPS",
+							"READ_LGE_SDX",
+							"READ_NOTIFICATIONS",
+							"SEARCH",
+							"WRITE_SETTINGS",
+							"WRITE_NOTIFICATION_ALERT",
+							"CONTROL_POWER",
+							"READ_CURRENT_CHANNEL",
+							"READ_RUNNING_APPS",
+							"READ_UPDATE_INFO",
+							"UPDATE_FROM_REMOTE_APP",
+							"READ_LGE_TV_INPUT_EVENTS",
+							"READ_TV_CURRENT_TIME",
+						}},
+						{"serial", "2f930e2d2cfe083771f68e4fe7bb07"},
+						{"vendorId", "com.lge"}}}}}})}};
+	}
+
+	nlohmann::json GetSwitchInputRequest(std::string input) {
+		return {
+			{"type", "request"},
+			{"uri", "ssap://tv/switchInput"},
+			{"payload", {{"inputId", std::move(input)}}},
+		};
+	}
+
+	void CheckResponse(std::string_view type, const nlohmann::json& payload, std::string_view uri) {
+		if (type != "response")
+			throw LGTVError("Unexpected response type from LGTV " + std::string(uri) + ": " + std::string(type));
+		const auto returnValue = payload.find("returnValue");
+		if (returnValue == payload.end() || *returnValue != true)
+			throw LGTVError("Unexpected response payload from LGTV " + std::string(uri) + ": " + payload.dump());
+	}
+
+	const std::string& LGTVProtocol::IssueRequest(nlohmann::json request, std::function<OnResponse> onResponse, std::function<OnError> onError) {
+		const Trace::Span traceSpan("LGTV request");
+		const auto requestId = ++lastRequestId;
+		request["id"] = requestId;
+		inflightRequests.insert({requestId, { .onResponse = std::move(onResponse), .onError = std::move(onError), .issueTime = std::chrono::steady_clock::now() }});
+		const auto uri = request.find("uri");
+		FlightRecorder::Write(FlightRecorder::RecordType::TV_REQUEST, (uri != request.end() ? *uri : request.at("type")).get_ref<const std::string&>());
+		// Unlike dump(), which returns a new string every time, operator<< writes through to the reused buffer.
+		message.clear();
+		messageStream << request;
+		return message;
+	}
+
+	void LGTVProtocol::OnMessage(std::string_view messageString) {
+		const Trace::Span traceSpan("LGTV response dispatch");
+		const auto message = nlohmann::json::parse(messageString);
+		const auto& type = message.at("type").get_ref<const std::string&>();
+		if (type == "error") {
+			const auto id = message.find("id");
+			const auto inflightRequest = id == message.end() ? inflightRequests.end() : inflightRequests.find(*id);
+			const auto error = message.value("error", std::string());
+			if (inflightRequest != inflightRequests.end())
+				FlightRecorder::Write(FlightRecorder::RecordType::TV_RESPONSE, error, inflightRequest->second.GetLatency());
+			if (inflightRequest == inflightRequests.end() || !inflightRequest->second.onError)
+				throw LGTVError("Received error response from LGTV: " + message.dump());
+			const auto onError = std::move(inflightRequest->second.onError);
+			inflightRequests.erase(inflightRequest);
+			onError(error);
+			return;
+		}
+
+		const uint32_t requestId = message.at("id");
+		const auto inflightRequest = inflightRequests.find(requestId);
+		if (inflightRequest == inflightRequests.end())
+			throw LGTVError("Unexpected response from LGTV: " + message.dump());
+		FlightRecorder::Write(FlightRecorder::RecordType::TV_RESPONSE, type, inflightRequest->second.GetLatency());
+
+		// Note the handler may issue new requests, which can invalidate `inflightRequest`.
+		if (inflightRequest->second.onResponse(type, message.at("payload")))
+			inflightRequests.erase(requestId);
+	}
+
+}
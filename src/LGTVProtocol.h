@@ -0,0 +1,92 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace LGTVDeviceListener {
+
+	// Thrown when the LGTV turns a request down (e.g. the input doesn't exist, or the user rejected pairing), or answers
+	// in a way we don't understand. Unlike connection failures, these would happen again if the request was retried.
+	class LGTVError final : public std::runtime_error {
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	nlohmann::json GetRegisterRequest(std::optional<std::string> clientKey);
+	nlohmann::json GetSwitchInputRequest(std::string input);
+
+	// Throws LGTVError if the response to the request for `uri` doesn't indicate success.
+	void CheckResponse(std::string_view type, const nlohmann::json& payload, std::string_view uri);
+
+	// The transport-independent part of LGTVClient: serializes requests to the LGTV, and dispatches response messages to
+	// the handlers of the requests they respond to.
+	class LGTVProtocol final {
+	public:
+		// Returns true if the request is complete, false if more responses are expected.
+		using OnResponse = bool(std::string_view type, const nlohmann::json& payload);
+		using OnError = void(std::string_view error);
+
+		LGTVProtocol() = default;
+
+		LGTVProtocol(const LGTVProtocol&) = delete;
+		LGTVProtocol& operator=(const LGTVProtocol&) = delete;
+
+		// Returns the message to send to the LGTV, which is only valid until the next call: messages are serialized into
+		// the same buffer, so that its capacity is reused. If `onError` is empty, error responses are fatal.
+		const std::string& IssueRequest(nlohmann::json request, std::function<OnResponse> onResponse, std::function<OnError> onError = nullptr);
+
+		// Throws LGTVError if the message doesn't respond to an in-flight request, or if it is an error response to a
+		// request without an error handler. Also throws whatever the response handler throws, and nlohmann::json
+		// exceptions if the message is malformed.
+		void OnMessage(std::string_view message);
+
+	private:
+		struct InflightRequest final {
+			std::function<OnResponse> onResponse;
+			std::function<OnError> onError;
+			std::chrono::steady_clock::time_point issueTime;
+
+			std::chrono::microseconds GetLatency() const {
+				return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - issueTime);
+			}
+		};
+
+		// Appends everything written to the stream to a string.
+		class StringAppender final : public std::streambuf {
+		public:
+			explicit StringAppender(std::string& string) : string(string) {}
+
+		protected:
+			int_type overflow(int_type character) override {
+				if (!traits_type::eq_int_type(character, traits_type::eof()))
+					string.push_back(traits_type::to_char_type(character));
+				return traits_type::not_eof(character);
+			}
+
+			std::streamsize xsputn(const char_type* characters, std::streamsize count) override {
+				string.append(characters, size_t(count));
+				return count;
+			}
+
+		private:
+			std::string& string;
+		};
+
+		uint32_t lastRequestId = 0;
+		std::unordered_map<uint32_t, InflightRequest> inflightRequests;
+		std::string message;
+		StringAppender messageAppender{ message };
+		std::ostream messageStream{ &messageAppender };
+	};
+
+}
@@ -0,0 +1,59 @@
+#include "LGTVProtocol.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		TEST(LGTVProtocolTest, SerializesRequestsWithIncreasingIds) {
+			LGTVProtocol protocol;
+			const auto onResponse = [](std::string_view, const nlohmann::json&) { return true; };
+			EXPECT_EQ(nlohmann::json::parse(protocol.IssueRequest(GetSwitchInputRequest("HDMI_1"), onResponse)).at("id"), 1);
+			const auto message = nlohmann::json::parse(protocol.IssueRequest(GetSwitchInputRequest("HDMI_2"), onResponse));
+			EXPECT_EQ(message.at("id"), 2);
+			EXPECT_EQ(message.at("payload").at("inputId"), "HDMI_2");
+		}
+
+		TEST(LGTVProtocolTest, DispatchesResponse) {
+			LGTVProtocol protocol;
+			std::optional<std::string> input;
+			protocol.IssueRequest(GetSwitchInputRequest("HDMI_1"), [&](std::string_view type, const nlohmann::json& payload) {
+				EXPECT_EQ(type, "response");
+				input = payload.at("inputId");
+				return true;
+			});
+			protocol.OnMessage(R"({"type":"response","id":1,"payload":{"returnValue":true,"inputId":"HDMI_1"}})");
+			EXPECT_EQ(input, "HDMI_1");
+			// The request is complete, so it can't be responded to again.
+			EXPECT_THROW(protocol.OnMessage(R"({"type":"response","id":1,"payload":{}})"), LGTVError);
+		}
+
+		TEST(LGTVProtocolTest, RejectedRequest) {
+			LGTVProtocol protocol;
+			protocol.IssueRequest(GetSwitchInputRequest("HDMI_5"), [](std::string_view type, const nlohmann::json& payload) {
+				CheckResponse(type, payload, "switchInput");
+				return true;
+			});
+			EXPECT_THROW(protocol.OnMessage(R"({"type":"response","id":1,"payload":{"returnValue":false}})"), LGTVError);
+		}
+
+		TEST(LGTVProtocolTest, ErrorResponse) {
+			LGTVProtocol protocol;
+			// As sent by the TV when the user rejects pairing.
+			protocol.IssueRequest(GetRegisterRequest(std::nullopt), [](std::string_view, const nlohmann::json&) { return true; });
+			EXPECT_THROW(protocol.OnMessage(R"({"type":"error","id":1,"error":"403 User denied access","payload":{}})"), LGTVError);
+
+			std::optional<std::string> error;
+			protocol.IssueRequest(GetSwitchInputRequest("HDMI_1"), [](std::string_view, const nlohmann::json&) { return true; }, [&](std::string_view message) {
+				error = message;
+			});
+			protocol.OnMessage(R"({"type":"error","id":2,"error":"500 Application error","payload":{}})");
+			EXPECT_EQ(error, "500 Application error");
+		}
+
+	}
+}
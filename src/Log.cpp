@@ -1,11 +1,16 @@
 #include "Log.h"
 
+#ifdef _WIN32
 #include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "StringUtil.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
-#include <io.h>
-#include <fcntl.h>
 
 namespace LGTVDeviceListener {
 
@@ -13,23 +18,50 @@ namespace LGTVDeviceListener {
 		if (state.has_value())
 			throw std::logic_error("Logging initialized twice");
 
+#ifdef _WIN32
 		if (options.channel == Channel::STDERR)
 			(void)_setmode(_fileno(stderr), _O_U16TEXT);
 
 		state = {
 			.verbose = options.verbose,
+			.discard = options.channel == Channel::NONE,
 			.windowsEventLog = options.channel == Channel::WINDOWS_EVENT_LOG ? RegisterEventSourceW(NULL, L"LGTVDeviceListener") : NULL,
 		};
+#else
+		// There is no Windows Event Log to write to on other platforms, so everything goes to stderr.
+		state = { .verbose = options.verbose, .discard = options.channel == Channel::NONE };
+#endif
 	}
 
 	std::optional<Log::State> Log::state;
 
-	Log::Log(Log::Level level) :
-		level(level) {
+	namespace {
+
+		struct ThreadStream final {
+			std::wostringstream stream;
+			bool inUse = false;
+		};
+		thread_local ThreadStream threadStream;
+
+	}
+
+	bool Log::IsEnabled(Level level) {
 		if (!state.has_value())
 			throw std::logic_error("Attempted to log before logging is initialized");
-		if (level != Level::VERBOSE || state->verbose) {
-			stream.emplace() << [&] {
+		return level != Level::VERBOSE || state->verbose;
+	}
+
+	Log::Log(Log::Level level) :
+		level(level) {
+		if (IsEnabled(level)) {
+			if (!threadStream.inUse) {
+				threadStream.inUse = true;
+				stream = &threadStream.stream;
+			}
+			else
+				stream = &nestedStream.emplace();
+
+			*stream << [&] {
 				switch (level) {
 				case Level::VERBOSE: return L"[verbose] ";
 				case Level::INFO:    return L"[info   ] ";
@@ -42,9 +74,23 @@ namespace LGTVDeviceListener {
 	}
 	
 	Log::~Log() {
-		if (!stream.has_value()) return;
-		auto str = std::move(stream)->str();
+		if (stream == nullptr) return;
+		// Moves the string out of the stream (C++20) instead of copying it.
+		auto str = std::move(*stream).str();
+		Output(str);
+
+		if (stream == &threadStream.stream) {
+			// Hand the string buffer back to the stream, so that the next message can reuse it.
+			str.clear();
+			stream->str(std::move(str));
+			stream->clear();
+			threadStream.inUse = false;
+		}
+	}
 
+	void Log::Output(const std::wstring& str) const {
+		if (state->discard) return;
+#ifdef _WIN32
 		const auto windowsEventLog = state->windowsEventLog;
 		if (windowsEventLog != NULL) {
 			auto cstr = str.c_str();
@@ -71,8 +117,32 @@ namespace LGTVDeviceListener {
 				/*lpStrings=*/&cstr,
 				/*lpRawData=*/NULL) != 0) return;
 		}
+#endif
+
+		std::wcerr << str << std::endl;
+	}
+
+	void Log::WriteUTF8(std::string_view text) {
+		// Decode through a fixed-size buffer, one chunk at a time.
+		constexpr size_t CHUNK_SIZE = 256;
+		while (!text.empty()) {
+			// Don't split a multi-byte sequence between chunks, as it would be decoded as two invalid sequences.
+			auto size = std::min(text.size(), CHUNK_SIZE);
+			for (int backtrack = 0; backtrack < 3 && size < text.size() && (uint8_t(text[size]) & 0xC0) == 0x80; ++backtrack) --size;
+			const auto chunk = text.substr(0, size);
+			text.remove_prefix(size);
 
-		std::wcerr << std::move(str) << std::endl;
+#ifdef _WIN32
+			wchar_t buffer[CHUNK_SIZE];
+			stream->write(buffer, std::streamsize(DecodeUTF8(chunk, buffer)));
+#else
+			// wchar_t is UTF-32 here; surrogate pairs are not combined, which is good enough for tests and benchmarks.
+			char16_t buffer[CHUNK_SIZE];
+			const auto decodedSize = DecodeUTF8(chunk, buffer);
+			for (size_t index = 0; index < decodedSize; ++index)
+				stream->put(wchar_t(buffer[index]));
+#endif
+		}
 	}
 
 }
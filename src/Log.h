@@ -1,15 +1,19 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 #include <optional>
 #include <sstream>
+#include <string_view>
 
 namespace LGTVDeviceListener {
 
 	class Log final {
 	public:
-		enum class Channel { STDERR, WINDOWS_EVENT_LOG };
+		// NONE formats messages as usual, then throws them away, e.g. to benchmark logging without measuring terminal I/O.
+		enum class Channel { STDERR, WINDOWS_EVENT_LOG, NONE };
 
 		struct Options final {
 			bool verbose = false;
@@ -19,6 +23,9 @@ namespace LGTVDeviceListener {
 
 		enum class Level { VERBOSE, INFO, WARNING, ERR };
 
+		// Useful to avoid formatting expensive arguments (e.g. converted strings) that would be thrown away anyway.
+		static bool IsEnabled(Level);
+
 		Log(Level);
 		~Log();
 
@@ -26,21 +33,41 @@ namespace LGTVDeviceListener {
 		Log& operator=(const Log&) = delete;
 
 		template <typename T> friend Log&& operator<<(Log&& lhs, T&& rhs) {
-			auto& stream = lhs.stream;
-			if (stream.has_value())
-				(*stream) << std::forward<T>(rhs);
+			if (lhs.stream != nullptr)
+				(*lhs.stream) << std::forward<T>(rhs);
+			return std::move(lhs);
+		}
+
+		// Formats UTF-8 text without going through a temporary wide string, e.g. `Log(...) << Log::UTF8(input)`.
+		struct UTF8 final {
+			explicit UTF8(std::string_view text) : text(text) {}
+			std::string_view text;
+		};
+		friend Log&& operator<<(Log&& lhs, UTF8 rhs) {
+			if (lhs.stream != nullptr)
+				lhs.WriteUTF8(rhs.text);
 			return std::move(lhs);
 		}
 
 	private:
 		struct State {
 			bool verbose = false;
+			bool discard = false;
+#ifdef _WIN32
 			HANDLE windowsEventLog = NULL;
+#endif
 		};
 		static std::optional<State> state;
 
+		void Output(const std::wstring&) const;
+		void WriteUTF8(std::string_view);
+
 		const Level level;
-		std::optional<std::wstringstream> stream;
+		// Points to a stream that is reused across messages logged by the same thread, so that logging doesn't allocate
+		// once the stream buffer has grown large enough. Messages logged while formatting another one use `nestedStream`
+		// instead. Null if the level is not enabled.
+		std::wostringstream* stream = nullptr;
+		std::optional<std::wostringstream> nestedStream;
 	};
 
 }
@@ -0,0 +1,30 @@
+#include "RttEstimator.h"
+
+#include <algorithm>
+
+namespace LGTVDeviceListener {
+
+	void RttEstimator::AddSample(std::chrono::microseconds rtt) {
+		backoffExponent = 0;
+		if (!smoothedRtt.has_value()) {
+			smoothedRtt = rtt;
+			rttVariation = rtt / 2;
+			return;
+		}
+		// alpha = 1/8, beta = 1/4
+		rttVariation = (3 * rttVariation + std::chrono::abs(*smoothedRtt - rtt)) / 4;
+		smoothedRtt = (7 * *smoothedRtt + rtt) / 8;
+	}
+
+	void RttEstimator::OnTimeout() {
+		backoffExponent = std::min(backoffExponent + 1, 10);
+	}
+
+	std::chrono::microseconds RttEstimator::GetTimeout(std::chrono::microseconds minimum, std::chrono::microseconds maximum) const {
+		if (!smoothedRtt.has_value()) return maximum;
+		constexpr auto clockGranularity = std::chrono::microseconds(std::chrono::milliseconds(1));
+		const auto timeout = (*smoothedRtt + std::max(clockGranularity, 4 * rttVariation)) * (1 << backoffExponent);
+		return std::min(std::max(timeout, minimum), maximum);
+	}
+
+}
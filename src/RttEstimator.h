@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+
+namespace LGTVDeviceListener {
+
+	// Estimates the round-trip time to a peer and derives a timeout from it, in the same way TCP computes its retransmission
+	// timeout (RFC 6298).
+	class RttEstimator final {
+	public:
+		void AddSample(std::chrono::microseconds rtt);
+
+		// Doubles the timeout until the next sample, as recommended by RFC 6298 section 5.5.
+		void OnTimeout();
+
+		// Returns the timeout clamped to [`minimum`, `maximum`], or `maximum` if no samples have been observed yet. If
+		// `minimum` is greater than `maximum`, `maximum` wins.
+		std::chrono::microseconds GetTimeout(std::chrono::microseconds minimum, std::chrono::microseconds maximum) const;
+
+	private:
+		std::optional<std::chrono::microseconds> smoothedRtt;
+		std::chrono::microseconds rttVariation = {};
+		int backoffExponent = 0;
+	};
+
+}
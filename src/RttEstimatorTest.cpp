@@ -0,0 +1,80 @@
+#include "RttEstimator.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		using std::chrono::microseconds;
+		using std::chrono::milliseconds;
+		using std::chrono::seconds;
+
+		// Wide enough to never clamp the timeouts under test.
+		microseconds GetTimeout(const RttEstimator& rttEstimator) {
+			return rttEstimator.GetTimeout(microseconds(0), seconds(1000));
+		}
+
+		TEST(RttEstimatorTest, NoSamples) {
+			const RttEstimator rttEstimator;
+			EXPECT_EQ(rttEstimator.GetTimeout(milliseconds(200), seconds(5)), seconds(5));
+		}
+
+		TEST(RttEstimatorTest, FirstSample) {
+			// SRTT = R, RTTVAR = R/2, so the timeout is R + 4 * R/2.
+			RttEstimator rttEstimator;
+			rttEstimator.AddSample(milliseconds(100));
+			EXPECT_EQ(GetTimeout(rttEstimator), milliseconds(300));
+		}
+
+		TEST(RttEstimatorTest, SubsequentSamples) {
+			RttEstimator rttEstimator;
+			rttEstimator.AddSample(milliseconds(100));
+			rttEstimator.AddSample(milliseconds(200));
+			// RTTVAR = 3/4 * 50 ms + 1/4 * |100 ms - 200 ms| = 62.5 ms
+			// SRTT = 7/8 * 100 ms + 1/8 * 200 ms = 112.5 ms
+			EXPECT_EQ(GetTimeout(rttEstimator), microseconds(112500 + 4 * 62500));
+
+			// A stable RTT makes the variation, and with it the timeout, converge towards the RTT.
+			for (int sample = 0; sample < 100; ++sample)
+				rttEstimator.AddSample(milliseconds(100));
+			EXPECT_GE(GetTimeout(rttEstimator), milliseconds(100));
+			EXPECT_LT(GetTimeout(rttEstimator), milliseconds(102));
+		}
+
+		TEST(RttEstimatorTest, ClockGranularity) {
+			RttEstimator rttEstimator;
+			rttEstimator.AddSample(microseconds(100));
+			// 4 * RTTVAR is below the 1 ms clock granularity, which is used instead.
+			EXPECT_EQ(GetTimeout(rttEstimator), microseconds(1100));
+		}
+
+		TEST(RttEstimatorTest, Backoff) {
+			RttEstimator rttEstimator;
+			rttEstimator.AddSample(milliseconds(100));
+			rttEstimator.OnTimeout();
+			EXPECT_EQ(GetTimeout(rttEstimator), milliseconds(600));
+			rttEstimator.OnTimeout();
+			EXPECT_EQ(GetTimeout(rttEstimator), milliseconds(1200));
+			// The backoff is capped.
+			for (int timeout = 0; timeout < 100; ++timeout)
+				rttEstimator.OnTimeout();
+			EXPECT_EQ(GetTimeout(rttEstimator), milliseconds(300 * 1024));
+			// A new sample ends the backoff. RTTVAR = 3/4 * 50 ms, SRTT = 100 ms.
+			rttEstimator.AddSample(milliseconds(100));
+			EXPECT_EQ(GetTimeout(rttEstimator), milliseconds(250));
+		}
+
+		TEST(RttEstimatorTest, Clamping) {
+			RttEstimator rttEstimator;
+			rttEstimator.AddSample(milliseconds(100));
+			EXPECT_EQ(rttEstimator.GetTimeout(seconds(1), seconds(5)), seconds(1));
+			EXPECT_EQ(rttEstimator.GetTimeout(milliseconds(10), milliseconds(200)), milliseconds(200));
+			EXPECT_EQ(rttEstimator.GetTimeout(milliseconds(10), seconds(5)), milliseconds(300));
+			// The maximum wins.
+			EXPECT_EQ(rttEstimator.GetTimeout(seconds(5), seconds(1)), seconds(1));
+		}
+
+	}
+}
@@ -0,0 +1,161 @@
+#include "Rules.h"
+
+#include "StringUtil.h"
+#include "Log.h"
+
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+#include <system_error>
+
+namespace LGTVDeviceListener {
+
+	namespace {
+
+		std::optional<std::string> GetOptionalString(const nlohmann::json& json, const char* key) {
+			const auto value = json.find(key);
+			if (value == json.end()) return std::nullopt;
+			return value->get<std::string>();
+		}
+
+		bool EqualsIgnoreCase(std::wstring_view lhs, std::wstring_view rhs) {
+			return ::CompareStringOrdinal(lhs.data(), int(lhs.size()), rhs.data(), int(rhs.size()), /*bIgnoreCase=*/TRUE) == CSTR_EQUAL;
+		}
+
+		// Returns the `VID_xxxx&PID_xxxx` part of a device name, if any. Note Windows is inconsistent in the case it uses
+		// for these, e.g. HID device names are often lowercase.
+		std::optional<std::wstring_view> FindVendorProductId(std::wstring_view deviceName) {
+			constexpr std::wstring_view pattern = L"VID_xxxx&PID_xxxx";
+			for (size_t index = 0; index + pattern.size() <= deviceName.size(); ++index) {
+				const auto candidate = deviceName.substr(index, pattern.size());
+				if (EqualsIgnoreCase(candidate.substr(0, 4), L"VID_") && EqualsIgnoreCase(candidate.substr(8, 5), L"&PID_"))
+					return candidate;
+			}
+			return std::nullopt;
+		}
+
+		class ManualResetEvent final {
+		public:
+			ManualResetEvent() : handle([&] {
+				const auto handle = ::CreateEventW(NULL, /*bManualReset=*/TRUE, /*bInitialState=*/FALSE, NULL);
+				if (handle == NULL)
+					throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to create event");
+				return handle;
+			}()) {}
+
+			ManualResetEvent(const ManualResetEvent&) = delete;
+			ManualResetEvent& operator=(const ManualResetEvent&) = delete;
+
+			~ManualResetEvent() { ::CloseHandle(handle); }
+
+			HANDLE GetHandle() const { return handle; }
+			void Set() { ::SetEvent(handle); }
+
+		private:
+			const HANDLE handle;
+		};
+
+		std::optional<std::filesystem::file_time_type> GetLastWriteTime(const std::filesystem::path& path) {
+			std::error_code error;
+			const auto lastWriteTime = std::filesystem::last_write_time(path, error);
+			if (error) return std::nullopt;
+			return lastWriteTime;
+		}
+
+	}
+
+	const std::optional<std::string>& Rules::GetInput(DeviceEventType deviceEventType) const {
+		switch (deviceEventType) {
+		case DeviceEventType::ADDED: return addInput;
+		case DeviceEventType::REMOVED: return removeInput;
+		}
+		::abort();
+	}
+
+	bool Rules::Matches(std::wstring_view deviceName) const {
+		return this->deviceName.has_value() && EqualsIgnoreCase(deviceName, *this->deviceName);
+	}
+
+	bool Rules::MightMatch(std::wstring_view deviceName) const {
+		if (!this->deviceName.has_value()) return false;
+		const auto vendorProductId = FindVendorProductId(*this->deviceName);
+		if (!vendorProductId.has_value()) return false;
+		const auto otherVendorProductId = FindVendorProductId(deviceName);
+		return otherVendorProductId.has_value() && EqualsIgnoreCase(*vendorProductId, *otherVendorProductId);
+	}
+
+	Rules LoadRulesFile(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) throw std::runtime_error("Unable to open rules file");
+
+		const auto json = nlohmann::json::parse(file);
+		if (!json.is_object()) throw std::runtime_error("Rules file must contain a JSON object");
+
+		const auto deviceName = GetOptionalString(json, "device-name");
+		return {
+			.deviceName = deviceName.has_value() ? std::optional<std::wstring>(ToWideString(*deviceName, CP_UTF8)) : std::nullopt,
+			.addInput = GetOptionalString(json, "add-input"),
+			.removeInput = GetOptionalString(json, "remove-input"),
+		};
+	}
+
+	void RulesFileWatcher::ChangeNotificationDeleter::operator()(HANDLE handle) const {
+		::FindCloseChangeNotification(handle);
+	}
+
+	RulesFileWatcher::RulesFileWatcher(std::filesystem::path path, std::function<OnChange> onChange) :
+		path(std::filesystem::absolute(std::move(path))), onChange(std::move(onChange)),
+		changeNotification([&] {
+			// We have to watch the whole directory because change notifications can't target a single file.
+			const auto handle = ::FindFirstChangeNotificationW(
+				this->path.parent_path().c_str(), /*bWatchSubtree=*/FALSE,
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+			if (handle == INVALID_HANDLE_VALUE)
+				throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to watch rules file directory");
+			return handle;
+		}()),
+		thread([this](std::stop_token stopToken) {
+			try {
+				Run(stopToken);
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::ERR) << L"Rules file watcher stopped due to error: " << ToWideString(exception.what(), CP_ACP);
+			}
+		}) {}
+
+	void RulesFileWatcher::Run(std::stop_token stopToken) {
+		ManualResetEvent stopEvent;
+		const std::stop_callback stopCallback(stopToken, [&] { stopEvent.Set(); });
+
+		auto lastWriteTime = GetLastWriteTime(path);
+		for (;;) {
+			const HANDLE handles[] = { stopEvent.GetHandle(), changeNotification.get() };
+			const auto waitResult = ::WaitForMultipleObjects(DWORD(std::size(handles)), handles, /*bWaitAll=*/FALSE, INFINITE);
+			if (waitResult == WAIT_OBJECT_0) return;
+			if (waitResult != WAIT_OBJECT_0 + 1)
+				throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to wait for rules file changes");
+
+			// Editors typically write files in several steps; give them some time to finish so that we don't load a partial file.
+			if (::WaitForSingleObject(stopEvent.GetHandle(), 100) == WAIT_OBJECT_0) return;
+			if (::FindNextChangeNotification(changeNotification.get()) == 0)
+				throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to watch rules file directory");
+
+			// Changes to other files in the same directory also wake us up, so check that our file actually changed.
+			const auto newLastWriteTime = GetLastWriteTime(path);
+			if (newLastWriteTime == lastWriteTime) continue;
+			lastWriteTime = newLastWriteTime;
+
+			Log(Log::Level::INFO) << L"Rules file changed, reloading";
+			std::optional<Rules> rules;
+			try {
+				rules = LoadRulesFile(path);
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::WARNING) << L"Unable to reload rules file, keeping previous rules: " << ToWideString(exception.what(), CP_ACP);
+				continue;
+			}
+			onChange(*std::move(rules));
+		}
+	}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "DeviceListener.h"
+
+#include <Windows.h>
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace LGTVDeviceListener {
+
+	struct Rules final {
+		std::optional<std::wstring> deviceName;
+		std::optional<std::string> addInput;
+		std::optional<std::string> removeInput;
+
+		// Device names are compared case-insensitively, because Windows is known to be inconsistent in the case it uses
+		// when reporting them.
+		bool Matches(std::wstring_view deviceName) const;
+		// Returns true if `deviceName` looks like it could belong to the same physical device as `this->deviceName`, because
+		// they share the same USB vendor and product IDs. Such device interfaces typically show up together, as a burst of
+		// events.
+		bool MightMatch(std::wstring_view deviceName) const;
+		const std::optional<std::string>& GetInput(DeviceEventType) const;
+	};
+
+	// Loads rules from a JSON file that looks like:
+	//   {"device-name": "\\\\?\\USB#...", "add-input": "HDMI_1", "remove-input": "HDMI_2"}
+	// All fields are optional and have the same meaning as the corresponding command line options.
+	Rules LoadRulesFile(const std::filesystem::path&);
+
+	// Reloads the rules file in a background thread whenever it changes, and passes the new rules to `onChange`.
+	// If the new file can't be loaded, a warning is logged and `onChange` is not called.
+	class RulesFileWatcher final {
+	public:
+		using OnChange = void(Rules);
+
+		RulesFileWatcher(std::filesystem::path, std::function<OnChange> onChange);
+
+		RulesFileWatcher(const RulesFileWatcher&) = delete;
+		RulesFileWatcher& operator=(const RulesFileWatcher&) = delete;
+
+	private:
+		struct ChangeNotificationDeleter final {
+			void operator()(HANDLE) const;
+		};
+
+		void Run(std::stop_token);
+
+		const std::filesystem::path path;
+		const std::function<OnChange> onChange;
+		const std::unique_ptr<std::remove_pointer_t<HANDLE>, ChangeNotificationDeleter> changeNotification;
+		std::jthread thread;
+	};
+
+}
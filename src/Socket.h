@@ -0,0 +1,47 @@
+#pragma once
+
+// Note: this header must be included before any header that includes Windows.h, because WinSock2.h must come before
+// Windows.h, otherwise the legacy Winsock 1 declarations get in the way.
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include <system_error>
+
+namespace LGTVDeviceListener {
+
+	class WinsockInitializer final {
+	public:
+		WinsockInitializer() {
+			::WSADATA wsaData;
+			const auto error = ::WSAStartup(MAKEWORD(2, 2), &wsaData);
+			if (error != 0)
+				throw std::system_error(std::error_code(error, std::system_category()), "Unable to initialize Winsock");
+		}
+
+		WinsockInitializer(const WinsockInitializer&) = delete;
+		WinsockInitializer& operator=(const WinsockInitializer&) = delete;
+
+		~WinsockInitializer() { ::WSACleanup(); }
+	};
+
+	class Socket final {
+	public:
+		Socket(int family, int type, int protocol) : socket([&] {
+			const auto socket = ::socket(family, type, protocol);
+			if (socket == INVALID_SOCKET)
+				throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to create socket");
+			return socket;
+		}()) {}
+
+		Socket(const Socket&) = delete;
+		Socket& operator=(const Socket&) = delete;
+
+		~Socket() { ::closesocket(socket); }
+
+		SOCKET Get() const { return socket; }
+
+	private:
+		const SOCKET socket;
+	};
+
+}
@@ -1,19 +1,173 @@
 #include "StringUtil.h"
 
+#include <stdexcept>
 #include <system_error>
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LGTVDEVICELISTENER_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace LGTVDeviceListener {
 
+	namespace {
+
+		template <typename CodeUnit>
+		size_t DecodeUTF8(std::string_view input, std::span<CodeUnit> output) {
+			static_assert(sizeof(CodeUnit) == 2);
+			// Every code unit we write consumes at least one input byte (surrogate pairs consume four), hence the bound.
+			if (output.size() < input.size())
+				throw std::logic_error("UTF-8 decoding output buffer is too small");
+
+			auto in = reinterpret_cast<const unsigned char*>(input.data());
+			const auto end = in + input.size();
+			auto out = output.data();
+			while (in < end) {
+#ifdef LGTVDEVICELISTENER_SSE2
+				// Fast path for ASCII, which is what we get most of the time: widen 16 bytes at a time.
+				while (end - in >= 16) {
+					const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+					if (_mm_movemask_epi8(chunk) != 0) break;
+					const auto zero = _mm_setzero_si128();
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(chunk, zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(chunk, zero));
+					in += 16;
+					out += 16;
+				}
+				if (in == end) break;
+#endif
+
+				const auto lead = *in++;
+				if (lead < 0x80) {
+					*out++ = CodeUnit(lead);
+					continue;
+				}
+
+				// See the "Well-Formed UTF-8 Byte Sequences" table in the Unicode Standard, section 3.9.
+				int continuationCount;
+				char32_t codePoint;
+				unsigned char lowerBound = 0x80;
+				unsigned char upperBound = 0xBF;
+				if (lead >= 0xC2 && lead <= 0xDF) {
+					continuationCount = 1;
+					codePoint = lead & 0x1F;
+				}
+				else if (lead >= 0xE0 && lead <= 0xEF) {
+					continuationCount = 2;
+					codePoint = lead & 0x0F;
+					if (lead == 0xE0) lowerBound = 0xA0;
+					if (lead == 0xED) upperBound = 0x9F;
+				}
+				else if (lead >= 0xF0 && lead <= 0xF4) {
+					continuationCount = 3;
+					codePoint = lead & 0x07;
+					if (lead == 0xF0) lowerBound = 0x90;
+					if (lead == 0xF4) upperBound = 0x8F;
+				}
+				else {
+					*out++ = CodeUnit(0xFFFD);
+					continue;
+				}
+
+				// An ill-formed sequence is replaced by a single U+FFFD, and decoding resumes at the offending byte.
+				for (; continuationCount > 0; --continuationCount) {
+					if (in == end || *in < lowerBound || *in > upperBound) break;
+					codePoint = (codePoint << 6) | (*in++ & 0x3F);
+					lowerBound = 0x80;
+					upperBound = 0xBF;
+				}
+				if (continuationCount > 0) {
+					*out++ = CodeUnit(0xFFFD);
+					continue;
+				}
+
+				if (codePoint < 0x10000) {
+					*out++ = CodeUnit(codePoint);
+					continue;
+				}
+				codePoint -= 0x10000;
+				*out++ = CodeUnit(0xD800 + (codePoint >> 10));
+				*out++ = CodeUnit(0xDC00 + (codePoint & 0x3FF));
+			}
+			return size_t(out - output.data());
+		}
+
+		template <typename CodeUnit>
+		size_t EncodeUTF8(std::basic_string_view<CodeUnit> input, std::span<char> output) {
+			static_assert(sizeof(CodeUnit) == 2);
+			// A code unit never takes more than 3 bytes (surrogate pairs take 4 bytes for 2 code units), hence the bound.
+			if (output.size() < 3 * input.size())
+				throw std::logic_error("UTF-8 encoding output buffer is too small");
+
+			auto out = output.data();
+			for (auto in = input.begin(); in != input.end(); ++in) {
+				char32_t codePoint = char16_t(*in);
+				if (codePoint < 0x80) {
+					*out++ = char(codePoint);
+					continue;
+				}
+				if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+					const auto next = in + 1;
+					if (codePoint <= 0xDBFF && next != input.end() && char16_t(*next) >= 0xDC00 && char16_t(*next) <= 0xDFFF) {
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (char16_t(*next) - 0xDC00);
+						in = next;
+					}
+					else
+						codePoint = 0xFFFD;
+				}
+
+				if (codePoint < 0x800) {
+					*out++ = char(0xC0 | (codePoint >> 6));
+				}
+				else if (codePoint < 0x10000) {
+					*out++ = char(0xE0 | (codePoint >> 12));
+					*out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+				}
+				else {
+					*out++ = char(0xF0 | (codePoint >> 18));
+					*out++ = char(0x80 | ((codePoint >> 12) & 0x3F));
+					*out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+				}
+				*out++ = char(0x80 | (codePoint & 0x3F));
+			}
+			return size_t(out - output.data());
+		}
+
+	}
+
+	size_t DecodeUTF8(std::string_view input, std::span<char16_t> output) {
+		return DecodeUTF8<char16_t>(input, output);
+	}
+
+	size_t EncodeUTF8(std::u16string_view input, std::span<char> output) {
+		return EncodeUTF8<char16_t>(input, output);
+	}
+
+#ifdef _WIN32
+	size_t DecodeUTF8(std::string_view input, std::span<wchar_t> output) {
+		return DecodeUTF8<wchar_t>(input, output);
+	}
+
+	size_t EncodeUTF8(std::wstring_view input, std::span<char> output) {
+		return EncodeUTF8<wchar_t>(input, output);
+	}
+
 	std::wstring ToWideString(std::string_view input, UINT codePage) {
 		if (input.size() == 0) return {};
 
-		const auto size = ::MultiByteToWideChar(codePage, 0, input.data(), int(input.size()), NULL, 0);
-		if (size <= 0) throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to get size for conversion to wide string");
+		// No code page produces more UTF-16 code units than there are input bytes, so we can size the output upfront
+		// instead of asking MultiByteToWideChar() for the size in a separate pass.
+		std::wstring result(input.size(), 0);
+		if (codePage == CP_UTF8) {
+			result.resize(DecodeUTF8(input, std::span(result)));
+			return result;
+		}
 
-		std::wstring result(size, 0);
-		if (::MultiByteToWideChar(codePage, 0, input.data(), int(input.size()), result.data(), int(result.size())) != int(result.size()))
-			throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to convert to wide string");
+		const auto size = ::MultiByteToWideChar(codePage, 0, input.data(), int(input.size()), result.data(), int(result.size()));
+		if (size <= 0) throw std::system_error(std::error_code(::GetLastError(), std::system_category()), "Unable to convert to wide string");
+		result.resize(size);
 		return result;
 	}
+#endif
 
 }
@@ -1,12 +1,29 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
+#include <span>
 #include <string_view>
 #include <string>
 
 namespace LGTVDeviceListener {
 
+	// Converts UTF-8 to UTF-16 into a caller-provided buffer, without allocating and without relying on any OS API.
+	// Invalid sequences are replaced with U+FFFD, as MultiByteToWideChar() does.
+	// `output` must be at least `input.size()` code units long, which is always enough. Returns the number of code units written.
+	size_t DecodeUTF8(std::string_view input, std::span<char16_t> output);
+
+	// Converts UTF-16 to UTF-8 into a caller-provided buffer, the other way around. Unpaired surrogates are replaced with
+	// U+FFFD, as WideCharToMultiByte() does.
+	// `output` must be at least 3 times `input.size()` bytes long. Returns the number of bytes written.
+	size_t EncodeUTF8(std::u16string_view input, std::span<char> output);
+#ifdef _WIN32
+	size_t DecodeUTF8(std::string_view input, std::span<wchar_t> output);
+	size_t EncodeUTF8(std::wstring_view input, std::span<char> output);
+
 	std::wstring ToWideString(std::string_view input, UINT codePage);
+#endif
 
 }
@@ -0,0 +1,159 @@
+#include "StringUtil.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		std::u16string Decode(std::string_view input) {
+			std::u16string output(input.size(), 0);
+			output.resize(DecodeUTF8(input, std::span(output)));
+			return output;
+		}
+
+		std::string Encode(std::u16string_view input) {
+			std::string output(3 * input.size(), 0);
+			output.resize(EncodeUTF8(input, std::span(output)));
+			return output;
+		}
+
+		TEST(DecodeUTF8Test, Empty) {
+			EXPECT_EQ(Decode(""), u"");
+		}
+
+		TEST(DecodeUTF8Test, WellFormed) {
+			EXPECT_EQ(Decode("\x24"), u"$");
+			EXPECT_EQ(Decode("\xC2\xA3"), u"£");
+			EXPECT_EQ(Decode("\xE2\x82\xAC"), u"€");
+			EXPECT_EQ(Decode("\xF0\x90\x8D\x88"), u"\U00010348");
+			EXPECT_EQ(Decode("LG Remote App \xEB\xA6\xAC\xEB\xAA\xA8\xEC\xBB\xA8 \xEC\x95\xB1"), u"LG Remote App 리모컨 앱");
+		}
+
+		TEST(DecodeUTF8Test, Boundaries) {
+			EXPECT_EQ(Decode(std::string_view("\x00", 1)), std::u16string(1, u'\0'));
+			EXPECT_EQ(Decode("\x7F"), u"\u007F");
+			EXPECT_EQ(Decode("\xC2\x80"), u"\u0080");
+			EXPECT_EQ(Decode("\xDF\xBF"), u"\u07FF");
+			EXPECT_EQ(Decode("\xE0\xA0\x80"), u"\u0800");
+			EXPECT_EQ(Decode("\xED\x9F\xBF"), u"\uD7FF");
+			EXPECT_EQ(Decode("\xEE\x80\x80"), u"\uE000");
+			EXPECT_EQ(Decode("\xEF\xBF\xBF"), u"\uFFFF");
+			EXPECT_EQ(Decode("\xF0\x90\x80\x80"), u"\U00010000");
+			EXPECT_EQ(Decode("\xF4\x8F\xBF\xBF"), u"\U0010FFFF");
+		}
+
+		// Ill-formed sequences are replaced with one U+FFFD per maximal subpart, as recommended by the Unicode Standard
+		// (section 3.9, "U+FFFD Substitution of Maximal Subparts") and as MultiByteToWideChar() does.
+
+		TEST(DecodeUTF8Test, Overlong) {
+			EXPECT_EQ(Decode("\xC0\xAF"), u"\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xC1\xBF"), u"\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xE0\x80\xAF"), u"\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xE0\x9F\xBF"), u"\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xF0\x80\x80\xAF"), u"\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xF0\x8F\xBF\xBF"), u"\uFFFD\uFFFD\uFFFD\uFFFD");
+		}
+
+		TEST(DecodeUTF8Test, Surrogates) {
+			EXPECT_EQ(Decode("\xED\xA0\x80"), u"\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xED\xAF\xBF"), u"\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xED\xB0\x80"), u"\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xED\xBF\xBF"), u"\uFFFD\uFFFD\uFFFD");
+			// A surrogate pair encoded as two separate three-byte sequences (CESU-8).
+			EXPECT_EQ(Decode("\xED\xA0\x80\xED\xB0\x80"), u"\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD");
+		}
+
+		TEST(DecodeUTF8Test, AboveMaximumCodePoint) {
+			EXPECT_EQ(Decode("\xF4\x90\x80\x80"), u"\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xF5\x80\x80\x80"), u"\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xF7\xBF\xBF\xBF"), u"\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xF8\x88\x80\x80\x80"), u"\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xFC\x84\x80\x80\x80\x80"), u"\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD\uFFFD");
+			EXPECT_EQ(Decode("\xFE\xFF"), u"\uFFFD\uFFFD");
+		}
+
+		TEST(DecodeUTF8Test, Truncated) {
+			EXPECT_EQ(Decode("\xC2"), u"\uFFFD");
+			EXPECT_EQ(Decode("\xE2\x82"), u"\uFFFD");
+			EXPECT_EQ(Decode("\xF0\x90\x8D"), u"\uFFFD");
+			// Decoding resumes at the byte that interrupted the sequence.
+			EXPECT_EQ(Decode("\xE2\x82" "A"), u"\uFFFDA");
+			EXPECT_EQ(Decode("\xF0\x90\x8D\xC2\xA3"), u"\uFFFD£");
+			EXPECT_EQ(Decode("A\xF0\x90"), u"A\uFFFD");
+		}
+
+		TEST(DecodeUTF8Test, UnexpectedContinuation) {
+			EXPECT_EQ(Decode("\x80"), u"\uFFFD");
+			EXPECT_EQ(Decode("\xBF\x80" "A"), u"\uFFFD\uFFFDA");
+			EXPECT_EQ(Decode("\xC2\xA3\xA3"), u"£\uFFFD");
+		}
+
+		// The SSE2 fast path handles 16 bytes at a time, so exercise inputs whose length and non-ASCII position straddle
+		// 16-byte chunks.
+		TEST(DecodeUTF8Test, ASCIIChunkBoundaries) {
+			for (size_t size = 0; size <= 50; ++size) {
+				std::string input;
+				std::u16string expected;
+				for (size_t index = 0; index < size; ++index) {
+					input.push_back(char(0x20 + index % 0x5F));
+					expected.push_back(char16_t(0x20 + index % 0x5F));
+				}
+				EXPECT_EQ(Decode(input), expected) << "size " << size;
+			}
+		}
+
+		TEST(DecodeUTF8Test, NonASCIIAtChunkBoundaries) {
+			for (size_t position = 0; position <= 34; ++position)
+				for (const auto& [sequence, decoded] : {
+					std::pair<std::string_view, std::u16string_view>("\xC3\xA9", u"é"),
+					std::pair<std::string_view, std::u16string_view>("\xE2\x82\xAC", u"€"),
+					std::pair<std::string_view, std::u16string_view>("\xF0\x9F\x93\xBA", u"\U0001F4FA"),
+					std::pair<std::string_view, std::u16string_view>("\xFF", u"\uFFFD"),
+					std::pair<std::string_view, std::u16string_view>("\xE2\x82", u"\uFFFD"),
+				}) {
+					const auto input = std::string(position, 'a') + std::string(sequence) + std::string(20, 'b');
+					const auto expected = std::u16string(position, u'a') + std::u16string(decoded) + std::u16string(20, u'b');
+					EXPECT_EQ(Decode(input), expected) << "position " << position;
+				}
+		}
+
+		TEST(DecodeUTF8Test, OutputTooSmall) {
+			char16_t output[2];
+			EXPECT_THROW(DecodeUTF8("abc", output), std::logic_error);
+		}
+
+		TEST(EncodeUTF8Test, WellFormed) {
+			EXPECT_EQ(Encode(u""), "");
+			EXPECT_EQ(Encode(u"$"), "\x24");
+			EXPECT_EQ(Encode(u"\u0080"), "\xC2\x80");
+			EXPECT_EQ(Encode(u"\u07FF"), "\xDF\xBF");
+			EXPECT_EQ(Encode(u"\u0800"), "\xE0\xA0\x80");
+			EXPECT_EQ(Encode(u"\uFFFF"), "\xEF\xBF\xBF");
+			EXPECT_EQ(Encode(u"\U00010000"), "\xF0\x90\x80\x80");
+			EXPECT_EQ(Encode(u"\U0010FFFF"), "\xF4\x8F\xBF\xBF");
+			EXPECT_EQ(Encode(u"LG Remote App 리모컨 앱"), "LG Remote App \xEB\xA6\xAC\xEB\xAA\xA8\xEC\xBB\xA8 \xEC\x95\xB1");
+		}
+
+		TEST(EncodeUTF8Test, UnpairedSurrogates) {
+			EXPECT_EQ(Encode(std::u16string{ 0xD800 }), "\xEF\xBF\xBD");
+			EXPECT_EQ(Encode(std::u16string{ 0xDC00 }), "\xEF\xBF\xBD");
+			EXPECT_EQ(Encode(std::u16string{ 0xD800, u'A' }), "\xEF\xBF\xBD" "A");
+			EXPECT_EQ(Encode(std::u16string{ 0xDC00, 0xD800 }), "\xEF\xBF\xBD\xEF\xBF\xBD");
+			EXPECT_EQ(Encode(std::u16string{ 0xD800, 0xD800, 0xDC00 }), "\xEF\xBF\xBD\xF0\x90\x80\x80");
+		}
+
+		TEST(EncodeUTF8Test, RoundTrip) {
+			const std::u16string input = u"\\\\?\\USB#VID_046D&PID_C52B#Caf\u00E9 \u20AC \U0001F4FA";
+			EXPECT_EQ(Decode(Encode(input)), input);
+		}
+
+		TEST(EncodeUTF8Test, OutputTooSmall) {
+			char output[5];
+			EXPECT_THROW(EncodeUTF8(u"ab", output), std::logic_error);
+		}
+
+	}
+}
@@ -0,0 +1,233 @@
+#include "TVController.h"
+
+#include "FlightRecorder.h"
+#include "StringUtil.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+
+namespace LGTVDeviceListener {
+
+	namespace {
+
+		// Past this many consecutive failures, failures are only logged in verbose mode, so that an unreachable TV
+		// doesn't flood the log.
+		constexpr unsigned maximumLoggedFailures = 3;
+
+		// Returns true if the TV was reached but the command can't succeed as is, e.g. because the TV rejected it or
+		// answered with something we don't understand. Anything else, such as the TV being unreachable or a timeout, is
+		// worth retrying.
+		bool IsPermanentFailure(const std::exception& exception) {
+			return dynamic_cast<const LGTVError*>(&exception) != nullptr || dynamic_cast<const nlohmann::json::exception*>(&exception) != nullptr;
+		}
+
+	}
+
+	TVController::TVController(Options options) :
+		options(std::move(options)),
+		tvLocator([&]() -> std::optional<TVLocator> {
+			if (!this->options.tvLocatorOptions.has_value()) return std::nullopt;
+			return std::optional<TVLocator>(std::in_place, *this->options.tvLocatorOptions);
+		}()),
+		thread([this](std::stop_token stopToken) {
+			try {
+				Run(stopToken);
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::ERR) << L"LGTV controller stopped due to error: " << ToWideString(exception.what(), CP_ACP);
+			}
+			if (warmUpHits > 0 || warmUpMisses > 0)
+				Log(Log::Level::INFO) << L"Speculative LGTV connections: " << warmUpHits << L" used, " << warmUpMisses << L" failed or unused";
+		}) {}
+
+	void TVController::SetInput(std::string input) {
+		{
+			std::scoped_lock lock(mutex);
+			pendingCommand = { .input = std::move(input), .traceEventId = Trace::Event::GetCurrentId() };
+		}
+		commandAvailable.notify_one();
+	}
+
+	void TVController::WarmUp() {
+		{
+			std::scoped_lock lock(mutex);
+			warmUpTraceEventId = Trace::Event::GetCurrentId();
+		}
+		commandAvailable.notify_one();
+	}
+
+	std::chrono::milliseconds TVController::GetMaximumStopTime() const {
+		// The locator is only stopped once the controller thread is done.
+		return WebSocketClient::GetMaximumStopTime(options.lgtvClientOptions.webSocketClientOptions) +
+			(tvLocator.has_value() ? TVLocator::MAXIMUM_STOP_TIME : std::chrono::milliseconds(0));
+	}
+
+	void TVController::Run(std::stop_token stopToken) {
+		std::minstd_rand random(std::random_device{}());
+		unsigned consecutiveFailures = 0;
+		for (;;) {
+			std::optional<Command> command;
+			uint64_t traceEventId;
+			{
+				std::unique_lock lock(mutex);
+				if (!commandAvailable.wait(lock, stopToken, [&] { return pendingCommand.has_value() || warmUpTraceEventId.has_value(); })) return;
+				command = std::exchange(pendingCommand, std::nullopt);
+				traceEventId = command.has_value() ? command->traceEventId : *warmUpTraceEventId;
+				warmUpTraceEventId.reset();
+			}
+
+			const Trace::Event::Scope traceEventScope(traceEventId);
+			auto start = std::chrono::steady_clock::now();
+			const auto getLatency = [&] { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start); };
+			// Warm-up requests made while we were connected are moot.
+			const auto discardWarmUp = [&] {
+				std::scoped_lock lock(mutex);
+				warmUpTraceEventId.reset();
+			};
+			try {
+				Execute(stopToken, command, start);
+				discardWarmUp();
+				if (stopToken.stop_requested()) return;
+				if (!command.has_value()) continue;
+				// The command might have been picked up by a speculative connection made on behalf of another event.
+				const Trace::Event::Scope commandTraceEventScope(command->traceEventId);
+				FlightRecorder::Write(FlightRecorder::RecordType::TV_COMMAND_DONE, command->input, getLatency());
+				if (consecutiveFailures > 0)
+					Log(Log::Level::INFO) << L"LGTV is reachable again";
+				consecutiveFailures = 0;
+				continue;
+			}
+			catch (const std::exception& exception) {
+				discardWarmUp();
+				if (stopToken.stop_requested()) return;
+				if (!command.has_value()) {
+					// Not worth retrying: if the TV is unreachable, the next command will find out and retry.
+					++warmUpMisses;
+					Log(Log::Level::VERBOSE) << L"Unable to connect to LGTV speculatively: " << ToWideString(exception.what(), CP_ACP)
+						<< L" (hits: " << warmUpHits << L", misses: " << warmUpMisses << L")";
+					continue;
+				}
+				const Trace::Event::Scope commandTraceEventScope(command->traceEventId);
+				FlightRecorder::Write(FlightRecorder::RecordType::TV_COMMAND_FAILED, exception.what(), getLatency());
+				if (IsPermanentFailure(exception)) {
+					Log(Log::Level::ERR) << L"Unable to switch LGTV to input " << ToWideString(command->input, CP_UTF8) << L", giving up: " << ToWideString(exception.what(), CP_ACP);
+					continue;
+				}
+				++consecutiveFailures;
+				if (tvLocator.has_value()) tvLocator->RequestRefresh();
+
+				// "Equal jitter" exponential backoff: the delay is chosen randomly between half the nominal delay and the nominal delay.
+				const auto nominalRetryDelay = std::min(
+					options.minimumRetryDelay * (int64_t(1) << std::min(consecutiveFailures - 1, 20u)),
+					options.maximumRetryDelay);
+				const auto retryDelay = std::chrono::milliseconds(std::uniform_int_distribution<std::chrono::milliseconds::rep>(
+					nominalRetryDelay.count() / 2, nominalRetryDelay.count())(random));
+				Log(consecutiveFailures <= maximumLoggedFailures ? Log::Level::WARNING : Log::Level::VERBOSE)
+					<< L"Unable to switch LGTV to input " << ToWideString(command->input, CP_UTF8) << L": " << ToWideString(exception.what(), CP_ACP)
+					<< L" - will retry in " << retryDelay.count() << L" ms"
+					<< (consecutiveFailures == maximumLoggedFailures ? L" (further failures will only be logged in verbose mode)" : L"");
+
+				if (!WaitForRetry(stopToken, retryDelay)) return;
+				std::scoped_lock lock(mutex);
+				// A new command supersedes the failed one.
+				if (!pendingCommand.has_value()) pendingCommand = *std::move(command);
+			}
+		}
+	}
+
+	void TVController::Execute(std::stop_token stopToken, std::optional<Command>& command, std::chrono::steady_clock::time_point& start) {
+		bool done = false;
+		std::optional<Trace::Event::Scope> commandTraceEventScope;
+		LGTVClient::Run(
+			GetUrl(), options.lgtvClientOptions, stopToken,
+			[&](LGTVClient& lgtvClient, std::string_view) {
+				if (!command.has_value()) {
+					command = WaitForCommand(stopToken);
+					if (!command.has_value()) {
+						lgtvClient.Close();
+						return;
+					}
+					start = std::chrono::steady_clock::now();
+					commandTraceEventScope.emplace(command->traceEventId);
+				}
+
+				// Switching inputs can blank the screen for a moment even if the input doesn't change, so avoid it if we can.
+				lgtvClient.GetCurrentInput([&](std::optional<std::string> currentInput) {
+					if (currentInput == command->input) {
+						Log(Log::Level::VERBOSE) << L"LGTV is already on input: " << ToWideString(command->input, CP_UTF8);
+						done = true;
+						lgtvClient.Close();
+						return;
+					}
+					lgtvClient.SetInput(command->input, [&] {
+						Log(Log::Level::VERBOSE) << L"LGTV successfully switched to input: " << ToWideString(command->input, CP_UTF8);
+						done = true;
+						lgtvClient.Close();
+					});
+				});
+			});
+		if (command.has_value() && !done && !stopToken.stop_requested())
+			throw std::runtime_error("LGTV connection closed before input could be switched");
+	}
+
+	std::optional<TVController::Command> TVController::WaitForCommand(std::stop_token stopToken) {
+		std::unique_lock lock(mutex);
+		for (;;) {
+			if (!commandAvailable.wait_for(lock, stopToken, options.warmUpGracePeriod, [&] { return pendingCommand.has_value() || warmUpTraceEventId.has_value(); })) {
+				if (stopToken.stop_requested()) return std::nullopt;
+				lock.unlock();
+				++warmUpMisses;
+				Log(Log::Level::VERBOSE) << L"Closing unused speculative LGTV connection (hits: " << warmUpHits << L", misses: " << warmUpMisses << L")";
+				return std::nullopt;
+			}
+			if (pendingCommand.has_value()) break;
+			// More events suggesting a command is coming: keep waiting.
+			warmUpTraceEventId.reset();
+		}
+		auto command = std::exchange(pendingCommand, std::nullopt);
+		lock.unlock();
+		++warmUpHits;
+		Log(Log::Level::VERBOSE) << L"Using speculative LGTV connection (hits: " << warmUpHits << L", misses: " << warmUpMisses << L")";
+		return command;
+	}
+
+	bool TVController::WaitForRetry(std::stop_token stopToken, std::chrono::milliseconds retryDelay) {
+		const auto deadline = std::chrono::steady_clock::now() + retryDelay;
+		std::unique_lock lock(mutex);
+		for (;;) {
+			const auto waitTime = std::min(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()), options.probeInterval);
+			if (commandAvailable.wait_for(lock, stopToken, waitTime, [&] { return pendingCommand.has_value(); }))
+				return !stopToken.stop_requested();
+			if (stopToken.stop_requested()) return false;
+			if (std::chrono::steady_clock::now() >= deadline) return true;
+
+			lock.unlock();
+			const auto reachable = [&] {
+				try {
+					return WebSocketClient::Probe(GetUrl(), options.lgtvClientOptions.webSocketClientOptions.connectTimeout);
+				}
+				catch (const std::exception&) {
+					return false;
+				}
+			}();
+			lock.lock();
+			if (reachable) {
+				Log(Log::Level::VERBOSE) << L"LGTV answered probe, retrying now";
+				return !stopToken.stop_requested();
+			}
+		}
+	}
+
+	std::string TVController::GetUrl() const {
+		if (!tvLocator.has_value()) return options.url;
+		const auto address = tvLocator->GetAddress();
+		if (!address.has_value()) throw std::runtime_error("LGTV has not been found on the network yet");
+		return ReplaceUrlHost(options.url, *address);
+	}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "LGTVClient.h"
+#include "TVLocator.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+namespace LGTVDeviceListener {
+
+	// Sends commands to a LGTV from a background thread, so that callers never have to wait for the TV.
+	//
+	// Commands describe the desired state of the TV rather than actions: once connected, the TV's current input is
+	// compared with the desired one, and a switch is only issued if they differ.
+	//
+	// If a command fails because the TV rejected it, or answered in a way we don't understand, it is dropped: retrying
+	// wouldn't help. If it fails for any other reason, the TV is considered unreachable and the command is retried with
+	// exponential backoff and jitter.
+	// While the TV is unreachable, only the latest command is kept: a new command replaces the failed one and is tried
+	// right away. The TV is probed periodically while waiting to retry, so that the command goes through as soon as the TV
+	// comes back. If the WebSocketClient probe option is set, retries also fail fast as long as the TV is still
+	// unreachable. The first successful command marks the TV as reachable again.
+	//
+	// If TV locator options are provided, the host in the URL is replaced with the current address of the TV as found by
+	// TVLocator, and a failed command triggers a new discovery in case the TV moved.
+	//
+	// Most of the time it takes to execute a command is spent connecting and registering with the TV. WarmUp() can be used
+	// to do that speculatively when a command is likely to follow; the connection is then kept open for a grace period,
+	// waiting for that command.
+	class TVController final {
+	public:
+		struct Options final {
+			std::string url;
+			LGTVClient::Options lgtvClientOptions;
+			std::optional<TVLocator::Options> tvLocatorOptions;
+			std::chrono::milliseconds minimumRetryDelay = std::chrono::seconds(1);
+			std::chrono::milliseconds maximumRetryDelay = std::chrono::minutes(1);
+			// How often the TV is probed while waiting to retry a command.
+			std::chrono::milliseconds probeInterval = std::chrono::seconds(5);
+			// How long a speculative connection is kept open if no command comes in.
+			std::chrono::milliseconds warmUpGracePeriod = std::chrono::seconds(5);
+		};
+
+		TVController(Options);
+
+		TVController(const TVController&) = delete;
+		TVController& operator=(const TVController&) = delete;
+
+		// Sets the input the TV should be on. Replaces any previously requested input that hasn't been applied yet.
+		void SetInput(std::string input);
+
+		// Connects to the TV ahead of time, in anticipation of a command. If a speculative connection is already open, its
+		// grace period starts over instead. Does nothing if a command is being executed.
+		void WarmUp();
+
+		// Returns an upper bound on how long destruction can take. Ongoing connection attempts can't be interrupted, so this
+		// depends on the configured timeouts.
+		std::chrono::milliseconds GetMaximumStopTime() const;
+
+	private:
+		struct Command final {
+			std::string input;
+			uint64_t traceEventId = 0;
+		};
+
+		void Run(std::stop_token);
+		// If `command` is empty, connects speculatively, and fills `command` and `start` if a command comes in during the
+		// grace period.
+		void Execute(std::stop_token, std::optional<Command>& command, std::chrono::steady_clock::time_point& start);
+		std::optional<Command> WaitForCommand(std::stop_token);
+		// Returns when `retryDelay` has elapsed, a new command came in, or the TV answered a probe, whichever comes first.
+		// Returns false if stop was requested.
+		bool WaitForRetry(std::stop_token, std::chrono::milliseconds retryDelay);
+		std::string GetUrl() const;
+
+		const Options options;
+		std::optional<TVLocator> tvLocator;
+		std::mutex mutex;
+		std::condition_variable_any commandAvailable;
+		std::optional<Command> pendingCommand;
+		// Set if WarmUp() was called and not acted upon yet, to the trace event ID of the caller.
+		std::optional<uint64_t> warmUpTraceEventId;
+		// Only accessed from `thread`. A miss is a speculative connection that failed, or that was closed without being used.
+		uint64_t warmUpHits = 0;
+		uint64_t warmUpMisses = 0;
+		std::jthread thread;
+	};
+
+}
@@ -0,0 +1,75 @@
+// Socket.h has to come first, see the note there.
+#include "Socket.h"
+
+#include "TVController.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		// A TCP server on the loopback interface that accepts connections (through the listen backlog) but never answers.
+		// This is the worst case for stopping TVController: the probe succeeds, and the connection attempt that follows
+		// can't be interrupted, so it runs until it times out.
+		class UnresponsiveServer final {
+		public:
+			UnresponsiveServer() {
+				::sockaddr_in address = { .sin_family = AF_INET };
+				address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+				int addressSize = sizeof(address);
+				if (::bind(socket.Get(), reinterpret_cast<const ::sockaddr*>(&address), addressSize) != 0 ||
+					::getsockname(socket.Get(), reinterpret_cast<::sockaddr*>(&address), &addressSize) != 0 ||
+					::listen(socket.Get(), SOMAXCONN) != 0)
+					throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to set up test server");
+				port = ::ntohs(address.sin_port);
+			}
+
+			std::string GetUrl() const { return "ws://127.0.0.1:" + std::to_string(port); }
+
+		private:
+			const WinsockInitializer winsockInitializer;
+			const Socket socket{ AF_INET, SOCK_STREAM, IPPROTO_TCP };
+			uint16_t port;
+		};
+
+		TEST(TVControllerTest, StopsWithinMaximumStopTime) {
+			const UnresponsiveServer server;
+			std::optional<TVController> tvController(std::in_place, TVController::Options{
+				.url = server.GetUrl(),
+				.lgtvClientOptions = { .webSocketClientOptions = { .connectTimeout = std::chrono::seconds(1), .handshakeTimeout = std::chrono::seconds(1), .probe = true } },
+			});
+			const auto maximumStopTime = tvController->GetMaximumStopTime();
+
+			tvController->SetInput("HDMI_1");
+			// Give the controller thread time to get past the probe and into the connection attempt.
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			const auto start = std::chrono::steady_clock::now();
+			tvController.reset();
+			EXPECT_LE(std::chrono::steady_clock::now() - start, maximumStopTime);
+		}
+
+		TEST(TVControllerTest, MaximumStopTimeFollowsTimeouts) {
+			const auto getMaximumStopTime = [](std::chrono::milliseconds timeout, bool probe) {
+				return TVController({
+					.url = "ws://127.0.0.1:9",
+					.lgtvClientOptions = { .webSocketClientOptions = { .connectTimeout = timeout, .handshakeTimeout = timeout, .probe = probe } },
+				}).GetMaximumStopTime();
+			};
+			EXPECT_GE(getMaximumStopTime(std::chrono::seconds(1), false), std::chrono::seconds(2));
+			EXPECT_GE(getMaximumStopTime(std::chrono::seconds(10), false), std::chrono::seconds(20));
+			// ix::WebSocket rounds timeouts up to whole seconds.
+			EXPECT_GE(getMaximumStopTime(std::chrono::milliseconds(1500), false), std::chrono::seconds(4));
+			// The probe is bounded by the connect timeout, and isn't rounded.
+			EXPECT_GE(getMaximumStopTime(std::chrono::seconds(1), true), std::chrono::seconds(3));
+			EXPECT_GE(getMaximumStopTime(std::chrono::milliseconds(1500), true), std::chrono::milliseconds(5500));
+		}
+
+	}
+}
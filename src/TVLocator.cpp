@@ -0,0 +1,226 @@
+#include "TVLocator.h"
+
+#include "Socket.h"
+#include "StringUtil.h"
+#include "Log.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+namespace LGTVDeviceListener {
+
+	namespace {
+
+		::sockaddr_in ParseSSDPDestination(std::string_view destination) {
+			const auto separator = destination.rfind(':');
+			if (separator == destination.npos)
+				throw std::runtime_error("SSDP destination must be of the form address:port: " + std::string(destination));
+			::sockaddr_in address = { .sin_family = AF_INET };
+			if (::inet_pton(AF_INET, std::string(destination.substr(0, separator)).c_str(), &address.sin_addr) != 1)
+				throw std::runtime_error("Unable to parse SSDP destination address: " + std::string(destination));
+			const auto port = destination.substr(separator + 1);
+			u_short portNumber;
+			const auto [end, error] = std::from_chars(port.data(), port.data() + port.size(), portNumber);
+			if (error != std::errc() || end != port.data() + port.size())
+				throw std::runtime_error("Unable to parse SSDP destination port: " + std::string(destination));
+			address.sin_port = ::htons(portNumber);
+			return address;
+		}
+
+		std::string GetSSDPSearchRequest(std::string_view destination) {
+			return
+				"M-SEARCH * HTTP/1.1\r\n"
+				"HOST: " + std::string(destination) + "\r\n"
+				"MAN: \"ssdp:discover\"\r\n"
+				"MX: 2\r\n"
+				"ST: urn:lge-com:service:webos-second-screen:1\r\n"
+				"\r\n";
+		}
+
+		bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+			return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char lhs, char rhs) {
+				return ::tolower(static_cast<unsigned char>(lhs)) == ::tolower(static_cast<unsigned char>(rhs));
+			});
+		}
+
+		// The TV ID is taken from the USN header, which looks like `USN: uuid:<TV ID>::urn:lge-com:service:webos-second-screen:1`.
+		std::optional<std::string> GetTVId(std::string_view response) {
+			while (!response.empty()) {
+				const auto lineEnd = response.find("\r\n");
+				auto line = response.substr(0, lineEnd);
+				response.remove_prefix(lineEnd == response.npos ? response.size() : lineEnd + 2);
+
+				const auto colon = line.find(':');
+				if (colon == line.npos || !EqualsIgnoreCase(line.substr(0, colon), "USN")) continue;
+				line.remove_prefix(colon + 1);
+				line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+
+				constexpr std::string_view uuidPrefix = "uuid:";
+				if (!line.starts_with(uuidPrefix)) return std::nullopt;
+				line.remove_prefix(uuidPrefix.size());
+				return std::string(line.substr(0, line.find("::")));
+			}
+			return std::nullopt;
+		}
+
+		std::map<std::string, std::string> LoadCache(const std::filesystem::path& path) {
+			try {
+				std::ifstream file(path, std::ios::binary);
+				if (!file) return {};
+				return nlohmann::json::parse(file).get<std::map<std::string, std::string>>();
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::WARNING) << L"Ignoring unreadable LGTV cache file: " << ToWideString(exception.what(), CP_ACP);
+				return {};
+			}
+		}
+
+		void SaveCache(const std::filesystem::path& path, const std::map<std::string, std::string>& knownTVs) {
+			// Write to a temporary file first so that we never leave a partially written cache behind.
+			auto temporaryPath = path;
+			temporaryPath += L".tmp";
+			{
+				std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+				file << nlohmann::json(knownTVs).dump(2);
+				if (!file) throw std::runtime_error("Unable to write LGTV cache file");
+			}
+			std::filesystem::rename(temporaryPath, path);
+		}
+
+	}
+
+	std::map<std::string, std::string> DiscoverTVs(std::string_view destination, std::chrono::milliseconds timeout, std::stop_token stopToken) {
+		WinsockInitializer winsockInitializer;
+		const auto destinationAddress = ParseSSDPDestination(destination);
+		const auto searchRequest = GetSSDPSearchRequest(destination);
+		const Socket socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+		// SSDP recommends a TTL of 2 so that the request doesn't travel too far.
+		const DWORD multicastTtl = 2;
+		if (::setsockopt(socket.Get(), IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&multicastTtl), sizeof(multicastTtl)) != 0)
+			throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to set SSDP multicast TTL");
+
+		if (::sendto(socket.Get(), searchRequest.data(), int(searchRequest.size()), 0, reinterpret_cast<const ::sockaddr*>(&destinationAddress), sizeof(destinationAddress)) == SOCKET_ERROR)
+			throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to send SSDP search request");
+
+		std::map<std::string, std::string> discoveredTVs;
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!stopToken.stop_requested()) {
+			const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+			if (remaining.count() <= 0) break;
+
+			// Wake up regularly to check for stop requests.
+			const auto waitTime = std::min(remaining, std::chrono::microseconds(std::chrono::milliseconds(100)));
+			const ::timeval selectTimeout = {
+				.tv_sec = long(waitTime.count() / 1000000),
+				.tv_usec = long(waitTime.count() % 1000000),
+			};
+			::fd_set readSet;
+			FD_ZERO(&readSet);
+			FD_SET(socket.Get(), &readSet);
+			const auto selectResult = ::select(0, &readSet, NULL, NULL, &selectTimeout);
+			if (selectResult == SOCKET_ERROR)
+				throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to wait for SSDP responses");
+			if (selectResult == 0) continue;
+
+			char response[2048];
+			::sockaddr_in source;
+			int sourceSize = sizeof(source);
+			const auto responseSize = ::recvfrom(socket.Get(), response, sizeof(response), 0, reinterpret_cast<::sockaddr*>(&source), &sourceSize);
+			if (responseSize == SOCKET_ERROR) continue;
+
+			const auto tvId = GetTVId(std::string_view(response, responseSize));
+			if (!tvId.has_value()) continue;
+			char address[INET_ADDRSTRLEN];
+			if (::inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address)) == NULL) continue;
+			discoveredTVs[*tvId] = address;
+		}
+		return discoveredTVs;
+	}
+
+	std::string ReplaceUrlHost(std::string_view url, std::string_view host) {
+		const auto schemeEnd = url.find("://");
+		const auto hostBegin = schemeEnd == url.npos ? 0 : schemeEnd + 3;
+		const auto hostEnd = std::min(url.find_first_of(":/", hostBegin), url.size());
+		std::string result(url.substr(0, hostBegin));
+		result += host;
+		result += url.substr(hostEnd);
+		return result;
+	}
+
+	TVLocator::TVLocator(Options options) :
+		options(std::move(options)),
+		knownTVs(LoadCache(this->options.cacheFile)),
+		thread([this](std::stop_token stopToken) { Run(stopToken); }) {}
+
+	std::optional<std::string> TVLocator::GetAddress() const {
+		std::scoped_lock lock(mutex);
+		const auto knownTV = knownTVs.find(options.tvId);
+		if (knownTV == knownTVs.end()) return std::nullopt;
+		return knownTV->second;
+	}
+
+	void TVLocator::RequestRefresh() {
+		{
+			std::scoped_lock lock(mutex);
+			refreshRequested = true;
+		}
+		refreshRequestedCondition.notify_one();
+	}
+
+	void TVLocator::Run(std::stop_token stopToken) {
+		for (;;) {
+			try {
+				auto discoveredTVs = DiscoverTVs(options.ssdpDestination, options.discoveryTimeout, stopToken);
+				// Discovery ends early when stopping, and would then report the TV as missing.
+				if (stopToken.stop_requested()) return;
+				Update(discoveredTVs);
+			}
+			catch (const std::exception& exception) {
+				Log(Log::Level::WARNING) << L"LGTV discovery failed: " << ToWideString(exception.what(), CP_ACP);
+			}
+
+			std::unique_lock lock(mutex);
+			refreshRequestedCondition.wait_for(lock, stopToken, options.refreshInterval, [&] { return refreshRequested; });
+			if (stopToken.stop_requested()) return;
+			refreshRequested = false;
+		}
+	}
+
+	void TVLocator::Update(const std::map<std::string, std::string>& discoveredTVs) {
+		// Discovery runs every few minutes, so only report changes.
+		const auto wasFound = std::exchange(found, discoveredTVs.find(options.tvId) != discoveredTVs.end());
+		if (!found)
+			Log(wasFound ? Log::Level::WARNING : Log::Level::VERBOSE) << L"LGTV " << ToWideString(options.tvId, CP_UTF8) << L" not found on the network";
+		else if (!wasFound)
+			Log(Log::Level::INFO) << L"LGTV " << ToWideString(options.tvId, CP_UTF8) << L" is back on the network";
+
+		std::map<std::string, std::string> newKnownTVs;
+		{
+			std::scoped_lock lock(mutex);
+			bool changed = false;
+			for (const auto& [tvId, address] : discoveredTVs) {
+				auto& knownAddress = knownTVs[tvId];
+				if (knownAddress == address) continue;
+				Log(Log::Level::INFO) << L"Found LGTV " << ToWideString(tvId, CP_UTF8) << L" at " << ToWideString(address, CP_UTF8);
+				knownAddress = address;
+				changed = true;
+			}
+			if (!changed) return;
+			newKnownTVs = knownTVs;
+		}
+
+		try {
+			SaveCache(options.cacheFile, newKnownTVs);
+		}
+		catch (const std::exception& exception) {
+			Log(Log::Level::WARNING) << L"Unable to save LGTV cache file: " << ToWideString(exception.what(), CP_ACP);
+		}
+	}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace LGTVDeviceListener {
+
+	// The standard SSDP multicast group.
+	constexpr std::string_view SSDP_MULTICAST_DESTINATION = "239.255.255.250:1900";
+
+	// Looks for WebOS TVs on the local network using SSDP, by sending a search request to `destination` (`address:port`,
+	// IPv4 only) and collecting responses for `timeout`. Returns TV addresses keyed by TV ID (i.e. their UUID, which
+	// doesn't change when the address does).
+	std::map<std::string, std::string> DiscoverTVs(std::string_view destination, std::chrono::milliseconds timeout, std::stop_token);
+
+	// Returns `url` with its host replaced by `host`, e.g. ReplaceUrlHost("wss://1.2.3.4:3001", "5.6.7.8") returns
+	// "wss://5.6.7.8:3001".
+	std::string ReplaceUrlHost(std::string_view url, std::string_view host);
+
+	// Keeps track of the current address of a given TV. Discovery runs periodically in a background thread, and on demand
+	// through RequestRefresh(); GetAddress() never waits for it. Known addresses are persisted in a cache file so that
+	// they are available immediately on the next startup.
+	class TVLocator final {
+	public:
+		struct Options final {
+			std::string tvId;
+			std::filesystem::path cacheFile;
+			std::chrono::milliseconds refreshInterval = std::chrono::minutes(10);
+			std::chrono::milliseconds discoveryTimeout = std::chrono::seconds(3);
+			// Where to send SSDP search requests. Only worth changing for testing.
+			std::string ssdpDestination = std::string(SSDP_MULTICAST_DESTINATION);
+		};
+
+		// Upper bound on how long destruction can take: discovery checks for stop requests every 100 ms, and the rest leaves
+		// room for writing the cache file.
+		static constexpr auto MAXIMUM_STOP_TIME = std::chrono::milliseconds(500);
+
+		TVLocator(Options);
+
+		TVLocator(const TVLocator&) = delete;
+		TVLocator& operator=(const TVLocator&) = delete;
+
+		// Returns std::nullopt if the TV hasn't been found yet.
+		std::optional<std::string> GetAddress() const;
+
+		// Typically called after failing to connect to the TV, as that suggests its address might have changed.
+		void RequestRefresh();
+
+	private:
+		void Run(std::stop_token);
+		void Update(const std::map<std::string, std::string>& discoveredTVs);
+
+		const Options options;
+		mutable std::mutex mutex;
+		std::condition_variable_any refreshRequestedCondition;
+		bool refreshRequested = false;
+		std::map<std::string, std::string> knownTVs;
+		// Whether the TV answered the last discovery. Starts out true, so that a TV that can't be found on startup is
+		// reported. Only accessed from `thread`.
+		bool found = true;
+		std::jthread thread;
+	};
+
+}
@@ -0,0 +1,109 @@
+// Socket.h has to come first, see the note there.
+#include "Socket.h"
+
+#include "TVLocator.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		constexpr std::string_view TV_ID = "3c2d1f0e-5a4b-4c3d-8e7f-0123456789ab";
+
+		// Answers SSDP search requests sent to a UDP port on the loopback interface, as a TV would.
+		class SSDPResponder final {
+		public:
+			SSDPResponder() {
+				::sockaddr_in address = { .sin_family = AF_INET };
+				address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+				int addressSize = sizeof(address);
+				if (::bind(socket.Get(), reinterpret_cast<const ::sockaddr*>(&address), addressSize) != 0 ||
+					::getsockname(socket.Get(), reinterpret_cast<::sockaddr*>(&address), &addressSize) != 0)
+					throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to set up SSDP responder");
+				destination = "127.0.0.1:" + std::to_string(::ntohs(address.sin_port));
+				thread = std::jthread([this](std::stop_token stopToken) { Run(stopToken); });
+			}
+
+			const std::string& GetDestination() const { return destination; }
+
+			// Stops answering, and returns the last request received.
+			std::string Stop() {
+				thread.request_stop();
+				thread.join();
+				return lastRequest;
+			}
+
+		private:
+			void Run(std::stop_token stopToken) {
+				while (!stopToken.stop_requested()) {
+					::fd_set readSet;
+					FD_ZERO(&readSet);
+					FD_SET(socket.Get(), &readSet);
+					const ::timeval selectTimeout = { .tv_sec = 0, .tv_usec = 100000 };
+					if (::select(0, &readSet, NULL, NULL, &selectTimeout) != 1) continue;
+
+					char request[2048];
+					::sockaddr_in source;
+					int sourceSize = sizeof(source);
+					const auto requestSize = ::recvfrom(socket.Get(), request, sizeof(request), 0, reinterpret_cast<::sockaddr*>(&source), &sourceSize);
+					if (requestSize == SOCKET_ERROR) continue;
+					lastRequest.assign(request, requestSize);
+
+					const auto response =
+						"HTTP/1.1 200 OK\r\n"
+						"CACHE-CONTROL: max-age=1800\r\n"
+						"ST: urn:lge-com:service:webos-second-screen:1\r\n"
+						"USN: uuid:" + std::string(TV_ID) + "::urn:lge-com:service:webos-second-screen:1\r\n"
+						"\r\n";
+					::sendto(socket.Get(), response.data(), int(response.size()), 0, reinterpret_cast<const ::sockaddr*>(&source), sourceSize);
+				}
+			}
+
+			const WinsockInitializer winsockInitializer;
+			const Socket socket{ AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+			std::string destination;
+			std::string lastRequest;
+			std::jthread thread;
+		};
+
+		TEST(TVLocatorTest, DiscoverTVs) {
+			SSDPResponder responder;
+			const auto discoveredTVs = DiscoverTVs(responder.GetDestination(), std::chrono::milliseconds(500), {});
+			const auto request = responder.Stop();
+			EXPECT_EQ(discoveredTVs, (std::map<std::string, std::string>{ { std::string(TV_ID), "127.0.0.1" } }));
+			EXPECT_TRUE(request.starts_with("M-SEARCH * HTTP/1.1\r\n")) << request;
+			EXPECT_NE(request.find("ST: urn:lge-com:service:webos-second-screen:1\r\n"), std::string::npos) << request;
+		}
+
+		TEST(TVLocatorTest, UpdatesAddressAndCache) {
+			const auto cacheFile = std::filesystem::temp_directory_path() / "LGTVDeviceListener-test.tv-cache.json";
+			std::filesystem::remove(cacheFile);
+
+			const SSDPResponder responder;
+			const TVLocator tvLocator({
+				.tvId = std::string(TV_ID),
+				.cacheFile = cacheFile,
+				.discoveryTimeout = std::chrono::milliseconds(500),
+				.ssdpDestination = responder.GetDestination(),
+			});
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			while (!tvLocator.GetAddress().has_value() && std::chrono::steady_clock::now() < deadline)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			EXPECT_EQ(tvLocator.GetAddress(), "127.0.0.1");
+			// The cache is written right after the address is updated, from the locator thread.
+			while (!std::filesystem::exists(cacheFile) && std::chrono::steady_clock::now() < deadline)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			EXPECT_TRUE(std::filesystem::exists(cacheFile));
+		}
+
+	}
+}
@@ -0,0 +1,11 @@
+#include "Log.h"
+
+#include <gtest/gtest.h>
+
+// Like GTest::gtest_main, but also initializes logging, which the code under test uses, including from its background
+// threads.
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	::LGTVDeviceListener::Log::Initialize({ .verbose = true, .channel = ::LGTVDeviceListener::Log::Channel::STDERR });
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+#include "Trace.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <iomanip>
+#include <stdexcept>
+
+namespace LGTVDeviceListener {
+
+	namespace {
+
+		// Enough for all the spans recorded in a flush interval under normal conditions, so that recording them doesn't
+		// allocate.
+		constexpr size_t reservedRecords = 1024;
+
+	}
+
+	void Trace::Initialize(const std::filesystem::path& path, std::chrono::milliseconds flushInterval) {
+		if (state.has_value())
+			throw std::logic_error("Tracing initialized twice");
+
+		auto& newState = state.emplace();
+		newState.epoch = std::chrono::steady_clock::now();
+		newState.file.open(path, std::ios::binary | std::ios::trunc);
+		if (!newState.file) {
+			state.reset();
+			throw std::runtime_error("Unable to open trace file");
+		}
+		// The closing bracket is optional in the Trace Event Format, which makes it possible to append to the file as we go.
+		newState.file << "[" << std::fixed << std::setprecision(3);
+		newState.file.flush();
+		newState.records.reserve(reservedRecords);
+		newState.writtenRecords.reserve(reservedRecords);
+		newState.flusher = std::jthread([&newState, flushInterval](std::stop_token stopToken) { newState.RunFlusher(stopToken, flushInterval); });
+	}
+
+	namespace {
+
+		uint32_t GetCurrentThreadId() {
+#ifdef _WIN32
+			return ::GetCurrentThreadId();
+#else
+			return uint32_t(::gettid());
+#endif
+		}
+
+		uint32_t GetCurrentProcessId() {
+#ifdef _WIN32
+			return ::GetCurrentProcessId();
+#else
+			return uint32_t(::getpid());
+#endif
+		}
+
+	}
+
+	std::optional<Trace::State> Trace::state;
+	std::atomic<uint64_t> Trace::lastEventId = 0;
+	thread_local uint64_t Trace::Event::currentId = 0;
+
+	Trace::Span::Span(const char* name) :
+		name(name),
+		start(state.has_value() ? std::optional(std::chrono::steady_clock::now()) : std::nullopt) {}
+
+	Trace::Span::~Span() {
+		if (!start.has_value()) return;
+		const auto end = std::chrono::steady_clock::now();
+		std::scoped_lock lock(state->mutex);
+		state->records.push_back({
+			.name = name,
+			.eventId = Event::GetCurrentId(),
+			.threadId = GetCurrentThreadId(),
+			.start = *start,
+			.duration = end - *start,
+		});
+	}
+
+	uint64_t Trace::AllocateEventId() {
+		return lastEventId.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	Trace::Event::Event() : scope(AllocateEventId()) {
+		if (state.has_value()) span.emplace("Device event");
+	}
+
+	// Spans recorded since the last write would otherwise be lost on exit.
+	Trace::State::~State() {
+		if (flusher.joinable()) {
+			flusher.request_stop();
+			flusher.join();
+		}
+		try {
+			Write();
+		}
+		catch (...) {}
+	}
+
+	void Trace::State::RunFlusher(std::stop_token stopToken, std::chrono::milliseconds flushInterval) {
+		for (;;) {
+			{
+				std::unique_lock lock(mutex);
+				flusherCondition.wait_for(lock, stopToken, flushInterval, [] { return false; });
+			}
+			if (stopToken.stop_requested()) return;
+			try {
+				Write();
+			}
+			catch (...) {}
+		}
+	}
+
+	void Trace::State::Write() {
+		{
+			std::scoped_lock lock(mutex);
+			records.swap(writtenRecords);
+		}
+		if (writtenRecords.empty()) return;
+
+		const auto processId = GetCurrentProcessId();
+		for (const auto& record : writtenRecords) {
+			using Microseconds = std::chrono::duration<double, std::micro>;
+			file << (empty ? "\n" : ",\n")
+				<< R"({"name":")" << record.name
+				<< R"(","cat":"LGTVDeviceListener","ph":"X","ts":)" << Microseconds(record.start - epoch).count()
+				<< R"(,"dur":)" << Microseconds(record.duration).count()
+				<< R"(,"pid":)" << processId
+				<< R"(,"tid":)" << record.threadId
+				<< R"(,"args":{"event":)" << record.eventId << "}}";
+			empty = false;
+		}
+		writtenRecords.clear();
+		file.flush();
+	}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace LGTVDeviceListener {
+
+	// Records timing spans in the Chrome Trace Event Format, so that they can be inspected in chrome://tracing or
+	// https://ui.perfetto.dev. Spans are buffered in memory, so that recording them never waits for I/O, and written to
+	// the file by a background thread every `flushInterval`, and when the program exits. Write errors are ignored.
+	class Trace final {
+	public:
+		static void Initialize(const std::filesystem::path&, std::chrono::milliseconds flushInterval = std::chrono::seconds(1));
+
+		// Records the time between construction and destruction. Does nothing if tracing is not initialized.
+		// `name` must outlive the trace, e.g. be a string literal.
+		class Span final {
+		public:
+			Span(const char* name);
+			~Span();
+
+			Span(const Span&) = delete;
+			Span& operator=(const Span&) = delete;
+
+		private:
+			const char* const name;
+			const std::optional<std::chrono::steady_clock::time_point> start;
+		};
+
+		// Tags all spans recorded on the current thread during its lifetime with a new correlation ID, so that all the
+		// spans caused by a given device event can be matched together.
+		// Correlation IDs are allocated even if tracing is not initialized, as they are also used by FlightRecorder.
+		class Event final {
+		public:
+			Event();
+
+			Event(const Event&) = delete;
+			Event& operator=(const Event&) = delete;
+
+			// Returns the correlation ID of the event currently being processed on this thread, or 0 if none.
+			static uint64_t GetCurrentId() { return currentId; }
+
+			// Sets the correlation ID of the current thread for the lifetime of the object. Useful to keep tracking an
+			// event after it was handed over to another thread.
+			class Scope final {
+			public:
+				Scope(uint64_t id) : previousId(currentId) { currentId = id; }
+				~Scope() { currentId = previousId; }
+
+				Scope(const Scope&) = delete;
+				Scope& operator=(const Scope&) = delete;
+
+			private:
+				const uint64_t previousId;
+			};
+
+		private:
+			static thread_local uint64_t currentId;
+
+			Scope scope;
+			std::optional<Span> span;
+		};
+
+	private:
+		struct Record final {
+			const char* name;
+			uint64_t eventId;
+			uint32_t threadId;
+			std::chrono::steady_clock::time_point start;
+			std::chrono::steady_clock::duration duration;
+		};
+
+		struct State final {
+			std::chrono::steady_clock::time_point epoch;
+			std::mutex mutex;
+			std::condition_variable_any flusherCondition;
+			std::vector<Record> records;
+			// Only accessed by `flusher`, and by the destructor once it's done. Records are swapped between `records` and
+			// `writtenRecords`, so that both keep their capacity and recording spans doesn't allocate.
+			std::ofstream file;
+			bool empty = true;
+			std::vector<Record> writtenRecords;
+			std::jthread flusher;
+
+			~State();
+			void RunFlusher(std::stop_token, std::chrono::milliseconds flushInterval);
+			void Write();
+		};
+		static std::optional<State> state;
+		static std::atomic<uint64_t> lastEventId;
+
+		static uint64_t AllocateEventId();
+	};
+
+}
@@ -0,0 +1,51 @@
+#include "Trace.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace LGTVDeviceListener {
+	namespace {
+
+		std::string ReadFile(const std::filesystem::path& path) {
+			std::ifstream file(path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+
+		// Returns the contents of the file once it contains `text`, or after a few seconds.
+		std::string WaitForFileContents(const std::filesystem::path& path, std::string_view text) {
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			for (;;) {
+				auto contents = ReadFile(path);
+				if (contents.find(text) != std::string::npos || std::chrono::steady_clock::now() >= deadline) return contents;
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		}
+
+		// Tracing can only be initialized once per process, so this is a single test.
+		TEST(TraceTest, WritesInBackground) {
+			const auto path = std::filesystem::temp_directory_path() / "LGTVDeviceListener-test.trace.json";
+			Trace::Initialize(path, std::chrono::milliseconds(10));
+
+			{
+				const Trace::Event event;
+			}
+			// As recorded by a thread working on behalf of an event, e.g. TVController.
+			{
+				const Trace::Event::Scope scope(42);
+				const Trace::Span span("Handed over span");
+			}
+			const auto contents = WaitForFileContents(path, "Handed over span");
+			EXPECT_NE(contents.find(R"({"name":"Device event")"), std::string::npos) << contents;
+			EXPECT_NE(contents.find(R"({"name":"Handed over span")"), std::string::npos) << contents;
+			EXPECT_NE(contents.find(R"("args":{"event":42})"), std::string::npos) << contents;
+		}
+
+	}
+}
@@ -1,8 +1,18 @@
 #include "WebSocketClient.h"
 
+#include "RttEstimator.h"
+#include "Socket.h"
+#include "Trace.h"
+
 #include <IXNetSystem.h>
+#include <IXUrlParser.h>
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
 
 namespace LGTVDeviceListener {
 
@@ -18,28 +28,55 @@ namespace LGTVDeviceListener {
 			}
 		};
 
+		// Don't time out faster than this even if the network is very fast, as a TV waking up from standby can take a while
+		// to answer. This is the minimum retransmission timeout recommended by RFC 6298 section 2.4.
+		constexpr auto minimumProbeTimeout = std::chrono::seconds(1);
+
+		// Keyed by "host:port".
+		std::mutex rttEstimatorsMutex;
+		std::map<std::string, RttEstimator, std::less<>> rttEstimators;
+
+		std::chrono::seconds RoundIxTimeout(std::chrono::milliseconds timeout) {
+			return std::chrono::ceil<std::chrono::seconds>(timeout);
+		}
+
+		int ToIxTimeout(std::chrono::milliseconds timeout) {
+			return int(RoundIxTimeout(timeout).count());
+		}
+
+		// Leaves room for closing the connection (ix::WebSocket waits for the server to acknowledge the close) and for
+		// scheduling delays.
+		constexpr auto closeTimeMargin = std::chrono::seconds(1);
+
 	}
 
-	void WebSocketClient::Run(const std::string& url, const Options& options, const std::function<OnOpen>& onOpen) {
+	void WebSocketClient::Run(const std::string& url, const Options& options, std::stop_token stopToken, FunctionRef<OnOpen> onOpen, FunctionRef<OnMessage> onMessage) {
+		if (stopToken.stop_requested()) return;
+
 		WebSocketClient webSocketClient;
 		auto& webSocket = webSocketClient.webSocket;
 
 		webSocket.setUrl(url);
-		webSocket.setHandshakeTimeout(options.handshakeTimeoutSeconds);
+		// ix::WebSocket only supports whole seconds.
+		webSocket.setHandshakeTimeout(ToIxTimeout(options.handshakeTimeout));
 		webSocket.disableAutomaticReconnection();
 		webSocket.setTLSOptions(options.tlsOptions);
 
-		std::function<OnMessage> onMessage;
+		bool open = false;
 		webSocket.setOnMessageCallback([&](const ix::WebSocketMessagePtr& webSocketMessage) {
 			using Type = ix::WebSocketMessageType;
 			switch (webSocketMessage->type) {
 			case Type::Message: {
-				if (!onMessage) throw std::runtime_error("Unexpected ix::WebSocket message callback");
+				const Trace::Span traceSpan("WebSocket message");
+				if (!open) throw std::runtime_error("Unexpected ix::WebSocket message callback");
+				// Note ix::WebSocket already allocated a string for this message; we can't avoid that, but at least we don't copy it.
 				onMessage(webSocketMessage->str);
 			} break;
 			case Type::Open: {
-				if (onMessage) throw std::runtime_error("ix::WebSocket delivered Open message twice");
-				onMessage = onOpen(webSocketClient);
+				const Trace::Span traceSpan("WebSocket open");
+				if (open) throw std::runtime_error("ix::WebSocket delivered Open message twice");
+				open = true;
+				onOpen(webSocketClient);
 			} break;
 			case Type::Error: {
 				const auto& errorInfo = webSocketMessage->errorInfo;
@@ -54,10 +91,85 @@ namespace LGTVDeviceListener {
 		});
 
 		IxNetSystemInitializer ixNetSystemInitializer;
-		webSocket.connect(options.connectTimeoutSeconds);
+		if (options.probe) {
+			const Trace::Span traceSpan("WebSocket probe");
+			if (!Probe(url, options.connectTimeout))
+				throw std::runtime_error("Unable to reach WebSocket server at " + url);
+		}
+		{
+			// Note: this includes TCP connection, TLS handshake and WebSocket handshake, as ix::WebSocket does them all in one go.
+			const Trace::Span traceSpan("WebSocket connect");
+			webSocket.connect(ToIxTimeout(options.connectTimeout));
+		}
+		const std::stop_callback stopCallback(stopToken, [&] { webSocket.close(); });
 		webSocket.run();
 	}
 
+	std::chrono::milliseconds WebSocketClient::GetMaximumStopTime(const Options& options) {
+		// The probe, then the connection itself, which ix::WebSocket bounds by both the connect and handshake timeouts.
+		return (options.probe ? options.connectTimeout : std::chrono::milliseconds(0)) + RoundIxTimeout(options.connectTimeout) + RoundIxTimeout(options.handshakeTimeout) + closeTimeMargin;
+	}
+
+	bool WebSocketClient::Probe(const std::string& url, std::chrono::milliseconds maximumTimeout) {
+		std::string protocol, host, path, query;
+		int port;
+		if (!ix::UrlParser::parse(url, protocol, host, path, query, port))
+			throw std::runtime_error("Unable to parse WebSocket URL: " + url);
+
+		const auto endpoint = host + ":" + std::to_string(port);
+		const auto timeout = [&] {
+			std::scoped_lock lock(rttEstimatorsMutex);
+			return rttEstimators[endpoint].GetTimeout(minimumProbeTimeout, maximumTimeout);
+		}();
+
+		IxNetSystemInitializer ixNetSystemInitializer;
+
+		const ::ADDRINFOA hints = {
+			.ai_family = AF_UNSPEC,
+			.ai_socktype = SOCK_STREAM,
+			.ai_protocol = IPPROTO_TCP,
+		};
+		::ADDRINFOA* addressInfo;
+		if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addressInfo) != 0) return false;
+		const std::unique_ptr<::ADDRINFOA, decltype(&::freeaddrinfo)> addressInfoDeleter(addressInfo, ::freeaddrinfo);
+
+		const Socket socket(addressInfo->ai_family, addressInfo->ai_socktype, addressInfo->ai_protocol);
+		u_long nonBlocking = 1;
+		if (::ioctlsocket(socket.Get(), FIONBIO, &nonBlocking) != 0)
+			throw std::system_error(std::error_code(::WSAGetLastError(), std::system_category()), "Unable to make socket non-blocking");
+
+		// A TCP connection takes exactly one round trip, which makes it a good RTT sample.
+		const auto start = std::chrono::steady_clock::now();
+		const auto onSuccess = [&] {
+			const auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+			std::scoped_lock lock(rttEstimatorsMutex);
+			rttEstimators[endpoint].AddSample(rtt);
+			return true;
+		};
+		if (::connect(socket.Get(), addressInfo->ai_addr, int(addressInfo->ai_addrlen)) == 0) return onSuccess();
+		if (::WSAGetLastError() != WSAEWOULDBLOCK) return false;
+
+		::fd_set writeSet, exceptSet;
+		FD_ZERO(&writeSet);
+		FD_SET(socket.Get(), &writeSet);
+		FD_ZERO(&exceptSet);
+		FD_SET(socket.Get(), &exceptSet);
+		const auto timeoutMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
+		const ::timeval selectTimeout = {
+			.tv_sec = long(timeoutMicroseconds / 1000000),
+			.tv_usec = long(timeoutMicroseconds % 1000000),
+		};
+		// Note: on Windows, failed non-blocking connection attempts are reported through the exception set, not the write set.
+		const auto selectResult = ::select(0, NULL, &writeSet, &exceptSet, &selectTimeout);
+		if (selectResult < 0) return false;
+		if (selectResult == 0) {
+			std::scoped_lock lock(rttEstimatorsMutex);
+			rttEstimators[endpoint].OnTimeout();
+			return false;
+		}
+		return FD_ISSET(socket.Get(), &writeSet) != 0 ? onSuccess() : false;
+	}
+
 	void WebSocketClient::Send(const std::string& data) {
 		webSocket.send(data);
 	}
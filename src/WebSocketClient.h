@@ -1,27 +1,52 @@
 #pragma once
 
+#include "FunctionRef.h"
+
 #include <IXWebSocket.h>
 
+#include <chrono>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 namespace LGTVDeviceListener {
 
 	class WebSocketClient final {
 	public:
 		struct Options final {
-			int connectTimeoutSeconds = 5;
-			int handshakeTimeoutSeconds = 5;
+			// ix::WebSocket only supports whole seconds, so both timeouts are rounded up for the connection attempt.
+			// `connectTimeout` also bounds the probe, whose actual timeout adapts to the round-trip times observed on previous
+			// connections (see Probe()). The connection attempt itself always gets the full timeouts.
+			std::chrono::milliseconds connectTimeout = std::chrono::seconds(5);
+			std::chrono::milliseconds handshakeTimeout = std::chrono::seconds(5);
 			ix::SocketTLSOptions tlsOptions;
+			// If set, Run() checks the endpoint using Probe() before connecting, so that an unreachable endpoint is detected
+			// without waiting for the full connect timeout. This costs one extra round trip when the endpoint is reachable.
+			bool probe = false;
 		};
 
 		WebSocketClient(const WebSocketClient&) = delete;
 		WebSocketClient& operator=(const WebSocketClient&) = delete;
 
-		using OnMessage = void(const std::string&);
-		using OnOpen = std::function<OnMessage>(WebSocketClient&);
+		using OnOpen = void(WebSocketClient&);
+		// The message is only valid for the duration of the call; it must be copied if it needs to outlive it.
+		using OnMessage = void(std::string_view);
 		
-		static void Run(const std::string& url, const Options& options, const std::function<OnOpen>& onOpen);
+		// Returns when the connection is closed, or when stop is requested on `stopToken`. `onMessage` is only called after `onOpen`.
+		// Note that stop requests can't interrupt ongoing connection attempts; these are bounded by the configured timeouts.
+		static void Run(const std::string& url, const Options& options, std::stop_token stopToken, FunctionRef<OnOpen> onOpen, FunctionRef<OnMessage> onMessage);
+
+		// Returns an upper bound on how long Run() can take to return once stop is requested, i.e. how long the longest
+		// connection attempt allowed by `options` can take, plus some time to close the connection.
+		static std::chrono::milliseconds GetMaximumStopTime(const Options& options);
+
+		// Checks if a TCP connection can be established to the host and port of the WebSocket URL.
+		// This is much cheaper than a full connection attempt, as it skips the TLS and WebSocket handshakes.
+		// The timeout is derived from the round-trip times previously observed for the same endpoint, up to `maximumTimeout`.
+		static bool Probe(const std::string& url, std::chrono::milliseconds maximumTimeout);
 
+		// Takes a std::string because that's what ix::WebSocket wants. LGTVProtocol serializes every message into the same
+		// string, so sending doesn't need a new one each time.
 		void Send(const std::string& data);
 		void Close();
 		